@@ -0,0 +1,68 @@
+#!/bin/sh
+# Check that FOCAL, left at its prompt after bench/loops.focal with the
+# input still open, waits for the host instead of spinning: the emulator
+# must use almost no CPU over some second before the input closes. Runs
+# each engine on the console, then a console server with sessions that
+# ran the script, reached through bash's /dev/tcp. Reads /proc, so Linux
+# only. Usage: bench/idle.sh path/to/pdp8 [engines...]
+emulator=${1:?usage: $0 path/to/pdp8 [engines...]}
+shift
+engines=${*:-switch threaded jit}
+cd "$(dirname "$0")/.." || exit 1
+scratch=$(mktemp -d) || exit 1
+trap 'rm -rf "$scratch"' EXIT
+mkfifo "$scratch/input" || exit 1
+status=0
+
+ticks() {
+    # utime + stime, after the command name, which may hold spaces
+    sed 's/.*) //' "/proc/$1/stat" | awk '{print $12 + $13}'
+}
+
+# Report whether process $1 settles into using no CPU within 10 s.
+settles() {
+    for second in 1 2 3 4 5 6 7 8 9 10; do
+        before=$(ticks "$1") || break
+        sleep 1
+        after=$(ticks "$1") || break
+        if [ $((after - before)) -le 2 ]; then
+            echo "idle after $second s"
+            return 0
+        fi
+    done
+    echo "busy after 10 s"
+    status=1
+}
+
+for engine in $engines; do
+    printf '%-9s ' "$engine"
+    "$emulator" -e "$engine" -o /dev/null <"$scratch/input" &
+    pid=$!
+    exec 3>"$scratch/input"
+    cat bench/loops.focal >&3
+    settles "$pid"
+    exec 3>&-  # end of input, and FOCAL's run
+    wait "$pid"
+done
+
+if command -v bash >/dev/null; then
+    printf '%-9s ' server
+    port=$((20000 + $$ % 10000))
+    "$emulator" -l "127.0.0.1:$port" -j 2 2>/dev/null &
+    pid=$!
+    sleep 1
+    clients=
+    # sessions a few instructions apart, so their idle loops start at
+    # either parity
+    for i in 1 2 3 4 5 6 7 8; do
+        bash -c 'exec 3<>"/dev/tcp/127.0.0.1/$1" && cat "$2" >&3 &&
+                 printf "T %d!\r" "$3" >&3 && exec sleep 30' - \
+            "$port" bench/loops.focal "$i" &
+        clients="$clients $!"
+    done
+    sleep 1
+    settles "$pid"
+    kill $clients "$pid" 2>/dev/null
+    wait
+fi
+exit $status
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Run every bench/*.raw image in lockstep against the switch core with each
+# engine and a range of block sizes. smc.raw has a DCA at 0204 that turns a
+# translated IAC at 0231 into a NOP, so some blocks end on the store.
+# Reproducers for any divergence are left in a scratch directory.
+# Usage: bench/lockstep.sh path/to/pdp8 [engines...]
+emulator=${1:?usage: $0 path/to/pdp8 [engines...]}
+shift
+engines=${*:-threaded jit}
+cd "$(dirname "$0")/.." || exit 1
+scratch=$(mktemp -d) || exit 1
+status=0
+for image in bench/*.raw; do
+    for engine in $engines; do
+        for block in 1 2 3 4 5 6 7 8; do
+            core=$scratch/$(basename "$image" .raw).$engine.$block
+            printf '%-24s %-9s %d ' "$image" "$engine" "$block"
+            "$emulator" -e "$engine" -f "$image" -i /dev/null -n 30 \
+                -L "$block" -C "$core" 2>"$core.log" >/dev/null || status=1
+            tail -1 "$core.log"
+        done
+    done
+done
+[ $status -eq 0 ] && rm -rf "$scratch"
+exit $status
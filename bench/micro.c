@@ -0,0 +1,260 @@
+// Microbenchmarks: one tiny guest program per instruction path, each a page
+// of the instruction under test ending in a NOP, for a skip to land on, and
+// a JMP back to its start, run headless through pdp8.h for a fixed number
+// of instructions. Every engine reports ns per instruction, the mean and
+// standard deviation of several timed runs, against a baseline file; a mean
+// more than the threshold over its baseline is a regression, and the exit
+// status is 1 if there is one.
+// Baselines only mean something on the host they were written on, so none
+// is kept in the tree: write one with -w before the change being measured.
+// bench/micro.sh builds and runs it.
+//
+// usage: micro [-w] [-b baseline] [-t percent] [-n instructions]
+//              [-r runs] [-e engine]... [benchmark...]
+//   -w  write the baseline from this run instead of comparing
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pdp8.h"
+
+#define START 00200
+#define END 00376   // the JMP back to START, after a NOP
+#define DATA 00377  // the current page operand
+#define NEXT 010000  // flag in a body word: add the address of the next word
+
+typedef struct {
+    const char *name;
+    unsigned body[4];  // repeated from START to the NOP
+    int length;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    // memory reference: page zero, current page, indirect, autoindex
+    {"and", {00020}, 1},
+    {"tad", {01020}, 1},
+    {"tad-current", {01377}, 1},
+    {"tad-indirect", {01430}, 1},
+    {"tad-autoindex", {01410}, 1},
+    {"isz", {02020}, 1},
+    {"isz-skip", {07240, 03020, 02020, 07000}, 4},  // every ISZ skips
+    {"dca", {03020}, 1},
+    {"dca-indirect", {03430}, 1},
+    {"jmp", {05200 | NEXT}, 1},
+    {"jms", {04021}, 1},  // to a JMP I back, which counts too
+    // group 1
+    {"cla", {07200}, 1},
+    {"cma", {07040}, 1},
+    {"cll-cml", {07120}, 1},
+    {"iac", {07001}, 1},
+    {"rar", {07010}, 1},
+    {"ral", {07004}, 1},
+    {"rtr", {07012}, 1},
+    {"rtl", {07006}, 1},
+    {"bsw", {07002}, 1},
+    {"cla-cma-iac", {07241}, 1},
+    // group 2: with AC 0 and the link clear, SZA, SNA... skip every other
+    {"sma", {07500}, 1},
+    {"sza", {07440}, 1},
+    {"snl", {07420}, 1},
+    {"sma-sza-snl", {07560}, 1},
+    {"skp", {07410}, 1},
+    {"spa", {07510}, 1},
+    {"sna", {07450}, 1},
+    {"szl", {07430}, 1},
+    {"spa-sna-szl", {07570}, 1},
+    // group 3
+    {"mql-mqa", {07421, 07501}, 2},
+};
+#define BENCHMARKS (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static const char *engineNames[] = {"switch", "threaded", "jit", "aot"};
+
+typedef struct {
+    char name[64];
+    char engine[16];
+    double ns;
+} Baseline;
+
+static Baseline *baseline;
+static int baselineCount;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A machine on engine with the benchmark's page loaded, at its start.
+static Pdp8 *build(const Benchmark *b, int engine) {
+    Pdp8 *m = pdp8New(engine);
+
+    if (m == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    for (unsigned a = START; a < END - 1; a++) {
+        unsigned word = b->body[(a - START) % b->length];
+        if (word & NEXT) word = (word & 07777) | ((a + 1) & 00177);
+        pdp8Write(m, a, word);
+    }
+    pdp8Write(m, END - 1, 07000);  // NOP
+    pdp8Write(m, END, 05200);      // JMP START
+    pdp8Write(m, DATA, 1);
+    pdp8Write(m, 00010, 00400);  // autoindex pointer
+    pdp8Write(m, 00020, 1);      // page zero operand
+    pdp8Write(m, 00021, 0);      // subroutine: return address
+    pdp8Write(m, 00022, 05421);  // JMP I 21
+    pdp8Write(m, 00030, 00040);  // pointer to 40
+    pdp8SetRegister(m, PDP8_PC, START);
+    return m;
+}
+
+static const Baseline *findBaseline(const char *name, const char *engine) {
+    for (int i = 0; i < baselineCount; i++)
+        if (strcmp(baseline[i].name, name) == 0 &&
+            strcmp(baseline[i].engine, engine) == 0)
+            return &baseline[i];
+    return NULL;
+}
+
+// Lines of benchmark, engine and ns per instruction; # starts a comment.
+static void readBaseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    Baseline b;
+
+    if (f == NULL) return;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %15s %lf", b.name, b.engine, &b.ns) != 3)
+            continue;
+        baseline = realloc(baseline, (baselineCount + 1) * sizeof(Baseline));
+        baseline[baselineCount++] = b;
+    }
+    fclose(f);
+}
+
+static int selected(const char *name, char **names, int count) {
+    if (count == 0) return 1;
+    for (int i = 0; i < count; i++)
+        if (strcmp(names[i], name) == 0) return 1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *baselinePath = "bench/micro.baseline";
+    double threshold = 10;  // percent
+    long long instructions = 20000000;
+    int runs = 5;
+    int write = 0;
+    int engines[4];
+    int engineCount = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:e:n:r:t:w")) != -1) {
+        switch (opt) {
+            case 'b':
+                baselinePath = optarg;
+                break;
+            case 'e': {
+                int e = 0;
+                while (e < 4 && strcmp(engineNames[e], optarg) != 0) e++;
+                if (e == 4 || engineCount == 4) {
+                    fprintf(stderr, "unknown engine: %s\n", optarg);
+                    return 2;
+                }
+                engines[engineCount++] = e;
+                break;
+            }
+            case 'n':
+                instructions = atoll(optarg);
+                if (instructions < 1) instructions = 1;
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                if (runs < 2) runs = 2;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'w':
+                write = 1;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s [-w] [-b baseline] [-t percent] "
+                        "[-n instructions] [-r runs] [-e engine]... "
+                        "[benchmark...]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if (engineCount == 0) {
+        engines[engineCount++] = PDP8_SWITCH;
+        engines[engineCount++] = PDP8_THREADED;
+        engines[engineCount++] = PDP8_JIT;
+    }
+    if (!write) readBaseline(baselinePath);
+    FILE *out = write ? fopen(baselinePath, "w") : NULL;
+    if (write && out == NULL) {
+        fprintf(stderr, "cannot write %s\n", baselinePath);
+        return 2;
+    }
+    if (out)
+        fprintf(out, "# benchmark engine ns/instruction, from bench/micro\n");
+
+    int regressions = 0;
+    double *ns = malloc(runs * sizeof(double));
+    for (int i = 0; i < BENCHMARKS; i++) {
+        const Benchmark *b = &benchmarks[i];
+        if (!selected(b->name, argv + optind, argc - optind)) continue;
+        for (int e = 0; e < engineCount; e++) {
+            const char *engine = engineNames[engines[e]];
+            Pdp8 *m = build(b, engines[e]);
+            pdp8Run(m, instructions / 10);  // warm up caches and translations
+            double sum = 0, squares = 0;
+            for (int r = 0; r < runs; r++) {
+                double start = now();
+                pdp8Run(m, instructions);
+                ns[r] = (now() - start) * 1e9 / instructions;
+                sum += ns[r];
+            }
+            double mean = sum / runs;
+            for (int r = 0; r < runs; r++)
+                squares += (ns[r] - mean) * (ns[r] - mean);
+            double deviation = sqrt(squares / (runs - 1));
+            unsigned pc = pdp8Register(m, PDP8_PC);
+            pdp8Free(m);
+            if (pc < START || pc > END) {
+                fprintf(stderr, "%s left its page, at %04o\n", b->name, pc);
+                return 2;
+            }
+
+            printf("%-14s %-9s %8.3f ns +- %6.3f", b->name, engine, mean,
+                   deviation);
+            const Baseline *base = findBaseline(b->name, engine);
+            if (out) {
+                fprintf(out, "%s %s %.3f\n", b->name, engine, mean);
+            } else if (base) {
+                double change = 100 * (mean - base->ns) / base->ns;
+                int regressed = change > threshold;
+                printf("  %+7.1f%%%s", change, regressed ? "  REGRESSION" : "");
+                regressions += regressed;
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    free(ns);
+    if (out && fclose(out) != 0) {
+        fprintf(stderr, "cannot write %s\n", baselinePath);
+        return 2;
+    }
+    if (regressions)
+        printf("%d regressions over %.1f%%\n", regressions, threshold);
+    return regressions ? 1 : 0;
+}
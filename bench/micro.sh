@@ -0,0 +1,11 @@
+#!/bin/sh
+# Build bench/micro.c against pdp8.c and run it from the top of the tree,
+# so its baseline is bench/micro.baseline. Usage: bench/micro.sh [options]
+# (see bench/micro.c); CC and CFLAGS are used if set.
+cd "$(dirname "$0")/.." || exit 1
+binary=${TMPDIR:-/tmp}/pdp8-micro.$$
+trap 'rm -f "$binary" "$binary.o"' EXIT
+${CC:-cc} ${CFLAGS:--O2} -DPDP8_LIBRARY -c -o "$binary.o" pdp8.c &&
+    ${CC:-cc} ${CFLAGS:--O2} -I. -o "$binary" bench/micro.c "$binary.o" \
+        -lpthread -lm || exit 2
+"$binary" "$@"
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Boot FOCAL on every bench/*.focal script with each engine and report the
+# speed. Usage: bench/run.sh path/to/pdp8 [engines...]
+emulator=${1:?usage: $0 path/to/pdp8 [engines...]}
+shift
+engines=${*:-switch threaded jit}
+cd "$(dirname "$0")/.." || exit 1
+for script in bench/*.focal; do
+    for engine in $engines; do
+        printf '%-24s %-9s ' "$script" "$engine"
+        "$emulator" -e "$engine" -i "$script" -o /dev/null -S 2>&1 >/dev/null |
+            grep MIPS
+    done
+done
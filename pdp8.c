@@ -1,10 +1,131 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pdp8.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+// an ahead-of-time translation is found through a weak symbol
+#if defined(__GNUC__) && defined(__ELF__)
+#define AOT_SUPPORTED
+#endif
+
+// Everything but the pdp8* interface in pdp8.h is static. What only main()
+// uses is left over in a library build, which has no main().
+#ifdef PDP8_LIBRARY
+#define MAIN_ONLY static __attribute__((unused))
+#else
+#define MAIN_ONLY static
+#endif
+
+#ifdef __linux__
+#define SERVER_SUPPORTED
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define MEMSIZE 32768  // 15-bit addresses-able memory
 
+// Binary core image: a 16-byte header, then the words packed two to three
+// bytes, high bits first. Header fields are little-endian:
+//   0  "PDP8"
+//   4  version (CORE_VERSION or CORE_SNAPSHOT)
+//   6  start address
+//   8  word count, loaded from address 0
+//  12  Adler-32 of everything after the header
+// A snapshot has the rest of the machine state between the header and the
+// words: a 16-bit size of the state, then
+//   0  AC
+//   2  link
+//   4  flags: keyboard, printer, ION, console interrupts, keyboard in use,
+//      EAE mode B, GT
+//   6  keyboard buffer
+//   8  printer buffer
+//  10  32-bit instructions until ION takes effect
+//  14  32-bit instructions until the keyboard event, NO_EVENT for none
+//  18  32-bit instructions until the printer event, NO_EVENT for none
+//  22  MQ
+//  24  step counter
+//  26  paper tape flags: reader, punch, interrupts
+//  28  reader buffer
+//  30  punch buffer
+//  32  32-bit instructions until the reader event, NO_EVENT for none
+//  36  32-bit instructions until the punch event, NO_EVENT for none
+//  40  32-bit reader position on its tape
+//  44  RK8-E command
+//  46  RK8-E status
+//  48  RK8-E current address
+//  50  RK8-E disk address
+//  52  32-bit instructions until the RK8-E finishes, NO_EVENT for none
+//  56  RF08 status
+//  58  RF08 flags: done, the transfer in progress writes the disk
+//  60  32-bit RF08 disk address
+//  64  32-bit instructions until the RF08 finishes, NO_EVENT for none
+//  68  fields: instruction field << 6 | instruction buffer << 3 | data field
+//  70  save field | a CIF or RMF waiting for a JMP or JMS << 6
+// Readers ignore state past the fields they know. Snapshots from before the
+// EAE end at 22, from before the paper tape devices at 26, from before
+// the disks at 44, from before the memory extension at 68.
+#define CORE_MAGIC "PDP8"
+#define CORE_VERSION 1
+#define CORE_SNAPSHOT 2
+#define CORE_HEADER 16
+#define SNAPSHOT_STATE 72
+#define SNAPSHOT_STATE_MIN 22
+#define NO_EVENT 0xffffffffu
+
+// Binary trace: a 32-byte header, then a ring of TraceRecords that holds
+// the last capacity instructions. The file is mapped and written in host
+// byte order, so decode it on the same kind of host:
+//   0  "P8TR"
+//   4  version (TRACE_VERSION)
+//   6  record size
+//   8  capacity, in records
+//  16  64-bit count of records written; record n is at n % capacity
+#define TRACE_MAGIC "P8TR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER 32
+#define TRACE_RECORDS (1 << 20)  // default capacity, 16 MB
+
+// Keyboard log: the only input that depends on the host, so a run can be
+// replayed exactly from its image and this. A 16-byte header:
+//   0  "P8KB"
+//   4  version (KEYLOG_VERSION)
+//   8  64-bit hash of memory as the run started
+// then one record for every character the keyboard delivered, and one for
+// the end of the input: the instructions since the last record, or since
+// the start, shifted left one and with the low bit set for the end of the
+// input, as a little-endian base 128 varint; then the character, unless
+// it is the end.
+#define KEYLOG_MAGIC "P8KB"
+#define KEYLOG_VERSION 1
+#define KEYLOG_HEADER 16
+
 // Operation Codes
 #define OP_AND 0
 #define OP_TAD 1
@@ -25,632 +146,6307 @@
 
 typedef unsigned short uint16;
 
-// I/O Device
-uint16 keyboardFlag = 0;
-uint16 keyboardBuffer = 0;
-uint16 printerFlag = 0;
-uint16 printerBuffer = 0;
+// Execution engines
+#define ENGINE_SWITCH PDP8_SWITCH      // reference interpreter, decodes
+                                       // every instruction
+#define ENGINE_THREADED PDP8_THREADED  // predecoded instruction cache,
+                                       // threaded dispatch
+#define ENGINE_JIT PDP8_JIT            // basic blocks translated to x86-64
+#define ENGINE_AOT PDP8_AOT            // routines translated to C ahead of
+                                       // time (-G)
 
-uint16 memory[MEMSIZE];
-uint16 AC = 0;  // accumulator; 12 bits
-uint16 PC = 0;  // program counter; 12 bits
+// Disk images are SIMH's: one 16-bit little-endian word per PDP-8 word,
+// from disk address 0. They are mapped, and a transfer is one data break
+// that copies a whole block between the mapping and memory.
+typedef struct {
+    uint16 *words;  // mapped image, or NULL for no disk
+    size_t size;    // in words
+    int locked;     // write-locked: a read-only file, or by the guest
+} DiskImage;
 
-uint16 LK = 0;  // link bit; 1 bit shifted 12 bits to the left
+// RK8-E disk controller, device 74, with up to four RK05 drives
+#define RK_DRIVES 4
+#define RK_BLOCK 256    // words per block
+#define RK_BLOCKS 6496  // 203 cylinders, 2 surfaces, 16 sectors
+#define RK_DELAY 100    // instructions a transfer or seek takes
 
-uint16 address;      // memory address
-uint16 inst;         // instruction from memory
-unsigned char I;     // I bit
-unsigned char page;  // Z bit
+#define RKC_IE 00400         // command: interrupt when done
+#define RKC_SEEK_DONE 00200  // set done when a seek ends
+#define RKC_HALF 00100       // transfer half a block
+#define RKC_FIELD 00070      // memory field of the transfer
+#define RKC_DRIVE 00006
+#define RKC_CYLINDER 00001   // high bit of the block number
 
-int isDebug = 0;
+#define RK_READ 0  // functions, in command bits 0-2
+#define RK_READ_ALL 1
+#define RK_WRITE_LOCK 2
+#define RK_SEEK 3
+#define RK_WRITE 4
+#define RK_WRITE_ALL 5
 
-uint16 getAddrPageZero(uint16 inst);
-uint16 getAddrPageCurrent(uint16 inst);
-uint16 getIndirectAddress(uint16 address);
-uint16 asciiToOctal(char c);
-void readCharacter();
-void printCharacter();
-void printDebug();
-void printDebugMicro();
+#define RKS_DONE 04000  // status
+#define RKS_NOT_READY 00200
+#define RKS_BUSY 00100
+#define RKS_WRITE_LOCK 00020
+#define RKS_DRIVE 00002
+#define RKS_CYLINDER 00001
 
-struct termios termios_old;
+// RF08 fixed-head disk, devices 60 to 64, with up to four RS08 platters
+// of 256K words. A DF32 image, 32K words a platter, reads as the start of
+// one. Transfers are three-cycle data breaks: a negative word count and
+// the current address less one are kept in field 0 at RF_WC and RF_CA.
+#define RF_WORDS (1 << 20)
+#define RF_WC 07750
+#define RF_CA 07751
+#define RF_DELAY 100  // instructions a transfer takes
 
-void reset_termios() { tcsetattr(0, TCSANOW, &termios_old); }
+#define RFS_PCA 04000  // status: photocell, never set here
+#define RFS_WRITE_LOCK 01000
+#define RFS_EIE 00400  // interrupt on an error
+#define RFS_PIE 00200  // interrupt on the photocell
+#define RFS_CIE 00100  // interrupt when done
+#define RFS_FIELD 00070
+#define RFS_LATE 00004
+#define RFS_NO_DISK 00002
+#define RFS_PARITY 00001
+#define RFS_LOAD 00770  // loaded by DIML
+#define RFS_ERRORS (RFS_WRITE_LOCK | RFS_LATE | RFS_NO_DISK | RFS_PARITY)
 
-int main() {
-    FILE *interpreterFile;
-    interpreterFile = fopen("focal.dump.nointerrupts.raw", "r");
+static int isDebug = 0;
+static int engine = ENGINE_THREADED;
+static const char *imagePath = "focal.dump.nointerrupts.raw";
+static long long limit = LLONG_MAX;  // instructions to run, for new machines
+static const char *sentinel = NULL;  // printer text to stop at, new machines
+static long long flushInterval = 100000;  // instructions output may wait
+static int checkpointAddress = -1;        // snapshot when the PC gets here
+static double speed = 0;           // multiple of real time, or 0 for flat out
+static double cycleTime = 1.2e-6;  // seconds per memory cycle, for governor
+MAIN_ONLY const char *tracePath = NULL;  // binary trace ring, new machines
+static uint32_t traceRecords = TRACE_RECORDS;
+MAIN_ONLY const char *profilePath = NULL;  // -P output prefix
+static const char *readerPath = NULL;      // paper tape in the reader
+static const char *rkPaths[RK_DRIVES];     // RK05 drive images
+static int rkDrives;
+static const char *rfPath = NULL;      // RF08 image
+static const char *bootDevice = NULL;  // rk or rf, to boot instead of an image
+static long long traceFrom = 0;        // -d and -t start at this instruction
+static volatile sig_atomic_t checkpointSignal = 0;  // SIGUSR1 asks for one
+static volatile sig_atomic_t monitorSignal = 0;  // enter the monitor, see -M
 
-    // load interpreter into memory
-    char ch;
-    int i = 0;
-    while (ch != EOF) {
-        uint16 word = 0;
-        for (int j = 3; j >= 0; j--) {
-            if ((ch = fgetc(interpreterFile)) == EOF) break;
-            word = word | (asciiToOctal(ch) << (j * 3));
-        }
-        memory[i] = word;
-        i++;
-    }
-    struct termios tios = termios_old;
-    tcgetattr(0, &termios_old);
-    atexit(reset_termios);
-    cfmakeraw(&tios);
-    tcsetattr(0, TCSANOW, &tios);
+// Operate bits, in the order the instruction mix reports them
+static const uint16 group1Bits[8] = {00200, 00100, 00040, 00020,
+                                     00010, 00004, 00002, 00001};
+static const char *group1Names[8] = {"CLA", "CLL", "CMA", "CML",
+                                     "RAR", "RAL", "BSW", "IAC"};
+static const uint16 group2Bits[6] = {00200, 00100, 00040, 00020, 00004, 00002};
+static const char *group2Names[2][6] = {
+    {"CLA", "SMA", "SZA", "SNL", "OSR", "HLT"},
+    {"CLA", "SPA", "SNA", "SZL", "OSR", "HLT"}};
 
-    PC = 0200;  // start at address 0200 (skip page 0)
-    while (1) {
-        // fetch instruction from memory
-        address = PC;
-        inst = memory[address];
+// Predecoded instruction cache, one record per memory word. A record whose
+// handler is H_DECODE is decoded on its next execution; every store into
+// memory resets the record of the word written, and of the word before it
+// if that is a superinstruction (see dropDecoded()).
+#define DECODE_INDIRECT 1        // address holds the pointer, not the operand
+#define DECODE_AUTOINDEX 2       // pointer is in 010 to 017
+#define DECODE_LOOP 4            // ISZ followed by JMP back to it
+#define DECODE_NEXT_AUTOINDEX 8  // superinstruction's second pointer is too
 
-        // decode instruction
-        I = (inst >> 8) & 00001;
-        page = (inst >> 7) & 00001;
+typedef struct {
+    unsigned char handler;  // index into the threaded engine's dispatch table
+    unsigned char flags;    // DECODE_*
+    uint16 address;  // effective (or pointer) address; the instruction word
+                     // itself for IOT and operate instructions
+    uint16 next;     // superinstructions: the second instruction's address
+    unsigned char cycles;      // memory cycles, see instCycles()
+    unsigned char nextCycles;  // superinstructions: the second's cycles
+} DecodedInst;
 
-        if (isDebug) {
-            printf("\n");
-            printDebug();
-            printDebugMicro();
-        }
+enum {
+    H_DECODE,
+    H_AND,
+    H_TAD,
+    H_ISZ,
+    H_DCA,
+    H_JMS,
+    H_JMP,
+    H_AND_I,
+    H_TAD_I,
+    H_ISZ_I,
+    H_DCA_I,
+    H_JMS_I,
+    H_JMP_I,
+    H_IOT,
+    H_GROUP1,
+    H_GROUP2,
+    H_GROUP3,
+    H_STOP,  // stop address, see setStopAddress()
 
-        // do operation
-        switch ((inst >> 9) & 07) {
-            case OP_AND:
-                // AND the operand into AC.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
+    // superinstructions: a word and the one after it run as one
+    H_TAD_DCA,    // TAD x; DCA y
+    H_TAD_DCA_I,  // TAD I x; DCA I y, usually autoindexed block moves
+    H_ISZ_JMP,    // ISZ x; JMP y, the bottom of a counted loop
+    H_CLA_TAD,    // CLA [CLL]; TAD x
+    H_COUNT
+};
+#define H_FUSED H_TAD_DCA
+#define FUSED_COUNT (H_COUNT - H_FUSED)
+static const char *fusedNames[FUSED_COUNT] = {"TAD DCA", "TADI DCAI",
+                                              "ISZ JMP", "CLA TAD"};
 
-                PC = (PC + 1) & 07777;
-                if (I == INDIRECT) address = getIndirectAddress(address);
+#ifdef JIT_SUPPORTED
+// Why translated code returned to runJit()
+#define JIT_EXIT_TRANSLATE 0  // no block at pc yet
+#define JIT_EXIT_SMC 1        // instruction at pc stores into translated code
+#define JIT_EXIT_BUDGET 2     // instruction budget used up
 
-                if (isDebug)
-                    printf("[AC = AC & M[%o] = %o & %o = %o] ", address, AC,
-                           memory[address], (AC & memory[address]));
-                AC = AC & memory[address];
-                break;
+// State shared with translated code, which addresses it through r15
+typedef struct {
+    void *entry[4096];         // native code for each address (must be first)
+    unsigned char code[4096];  // word belongs to a translated block
+    uint16 *memory;
+    long long budget;  // instructions left to run
+    long long cycles;  // memory cycles run since runJit() last took them
+    uint16 ac;
+    uint16 lk;
+    uint16 pc;
+    uint16 smcAddress;  // word the JIT_EXIT_SMC instruction stores into
+    int reason;         // JIT_EXIT_*
+} JitContext;
 
-            case OP_TAD:
-                // ADD the operand to AC.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
+#define JIT_BUFSIZE (4 << 20)
+#define JIT_BLOCK_MAX 64         // instructions per block
+#define JIT_BLOCK_ROOM 32768     // worst-case bytes for one block
+#define JIT_STUBS_MAX (2 * JIT_BLOCK_MAX + 1)
 
-                PC = (PC + 1) & 07777;
-                if (I == INDIRECT) address = getIndirectAddress(address);
+// Cold exit paths, emitted after the body of each block
+#define STUB_BUDGET 0     // not enough budget left for the whole block
+#define STUB_SMC_CONST 1  // store into translated code, address known
+#define STUB_SMC_ECX 2    // store into translated code, address in ecx
 
-                if (isDebug)
-                    printf("[L|AC = L|AC + M[%o] = %o + %o = %o] ", address,
-                           (LK | AC), memory[address],
-                           ((AC | LK) + memory[address]));
-                AC = (AC | LK) + memory[address];
-                LK = AC & 010000;
-                AC = AC & 007777;
-                break;
+typedef struct {
+    int kind;
+    int patch;    // offset of the jcc rel32 to point at the stub
+    int index;    // instruction in the block the stub leaves at
+    uint16 pc;    // address of that instruction
+    uint16 smcAddress;
+} JitStub;
 
-            case OP_ISZ:
-                // Increment operand. If zero, SKIP next instruction.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
+// Translator state of one machine
+typedef struct {
+    JitContext context;
+    unsigned char *buffer;  // code buffer, JIT_BUFSIZE bytes
+    int used;               // bytes of buffer in use
+    int fixed;              // bytes taken by the enter/exit/translate code
+    int exitOffset;
+    int translateOffset;
+    void (*enter)(JitContext *);
+    JitStub stubs[JIT_STUBS_MAX];
+    int stubCount;
+} Jit;
+#endif
 
-                PC = (PC + 1) & 07777;
-                if (I == INDIRECT) address = getIndirectAddress(address);
+// Ahead-of-time translation, see aotGenerate(). The generated C file is
+// given these definitions as text, so AOT_VERSION must change with them.
+// owner[] holds, for every translated word, 1 + the index of the routine
+// that has it; image[] is field 0 as it was translated.
+#define AOT_VERSION 1
+#define AOT_DEFINITIONS                           \
+    typedef struct {                              \
+        uint16 *memory;                           \
+        long long budget;                         \
+        long long cycles;                         \
+        uint16 ac;                                \
+        uint16 lk;                                \
+        uint16 pc;                                \
+        int reason;                               \
+    } AotContext;                                 \
+    typedef struct {                              \
+        int version;                              \
+        int routines;                             \
+        const uint16 *image;                      \
+        const uint16 *owner;                      \
+        void (*const *routine)(AotContext *);     \
+    } AotUnit;
+#define AOT_TEXT(...) #__VA_ARGS__
+#define AOT_STRING(definitions) AOT_TEXT(definitions)
+AOT_DEFINITIONS
 
-                if (isDebug) {
-                    printf("[M[%o] = M[%o] + 1 = %o + 1 = %o] ", address,
-                           address, memory[address],
-                           ((memory[address] + 1) & 07777));
-                }
-                uint16 buf = memory[address] = ((memory[address] + 1) & 07777);
-                if (buf == 0) PC = (PC + 1) & 07777;
-                break;
+// Why a translated routine returned to runAot()
+#define AOT_EXIT_LEAVE 0      // pc is in another routine, or in none
+#define AOT_EXIT_INTERPRET 1  // instruction at pc is for stepSwitch()
 
-            case OP_DCA:
-                // Put accumulator into memory.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
+#ifdef AOT_SUPPORTED
+extern const AotUnit aotUnit __attribute__((weak));
 
-                PC = (PC + 1) & 07777;
-                if (I == INDIRECT) address = getIndirectAddress(address);
+typedef struct {
+    AotContext context;
+    unsigned char *off;  // by routine: its code changed, or it has a word
+                         // the engines stop at, so it is interpreted
+} Aot;
+#endif
 
-                if (isDebug) printf("[M[%o] = AC = %o; AC = 0] ", address, AC);
-                memory[address] = AC;
-                AC = 0;
-                break;
+// Instruction mix, counted by the reference interpreter
+typedef struct {
+    long long opcode[8];    // by OP_*
+    long long operate[4];   // group 1, group 2 or, group 2 and, group 3
+    long long group1[8];     // by bit, see group1Names
+    long long group2[2][6];  // or, and group by bit, see group2Names
+} Mix;
 
-            case OP_JMS:
-                // Store return address then JUMP to subroutine.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
-                if (I == INDIRECT) address = getIndirectAddress(address);
+// Execution profile, counted by the reference interpreter. A JMS opens a
+// frame for its target. A JMP I through the target, or to just after the
+// JMS, closes it, which also covers skip returns and FOCAL's PUSHJ/POPJ.
+// A JMS overwrites the return address of any earlier call to the same
+// routine, so that call is closed too: routines that never come back, like
+// the floating point interpreter, do not pile up. Inclusive counts are
+// approximate for those. Each distinct call stack is a node of a tree,
+// which gives the folded stacks for flame graphs without a lookup per
+// instruction.
+#define PROFILE_DEPTH 64      // frames kept; the oldest go first
+#define PROFILE_SKIP 3        // return addresses up to two words after JMS
+#define PROFILE_NODES 16384   // distinct call stacks
+#define PROFILE_HASH 32768    // (parent, routine) to node
+#define PROFILE_TOP 20        // routines and loops in the listing summary
 
-                if (isDebug)
-                    printf("[M[%o] = returnPC = %o; new PC = %o] ", address,
-                           ((PC + 1) & 07777), ((address + 1) & 07777));
-                address = (address & 07777);
-                memory[address] = (PC + 1) & 07777;
-                PC = (address + 1) & 07777;
-                break;
+typedef struct {
+    uint16 routine;   // JMS target
+    uint16 caller;    // return address the JMS stored
+    int parent;       // call stack node to go back to on return
+    long long start;  // instructions when it was called
+} Frame;
 
-            case OP_JMP:
-                // JUMP to address.
-                if (page == CURRENT)
-                    address = getAddrPageCurrent(inst);
-                else
-                    address = getAddrPageZero(inst);
-                if (I == INDIRECT) address = getIndirectAddress(address);
-
-                if (isDebug) printf("[new PC = %o] ", (address & 07777));
-                PC = address & 07777;
-                break;
-
-            case OP_IO:  // Input/Output Transfer
-                PC = (PC + 1) & 07777;
-                switch ((inst >> 3) & 077) {
-                    case 003:  // Console keyboard input
-                        switch (inst & 07) {
-                            case 00:  // KCF
-                                keyboardFlag = 0;
-                                break;
-                            case 01:  // KSF
-                                // Always skip next instruction because scanf in
-                                // C already waits for keyboard input
-                                PC = (PC + 1) & 07777;
-                                break;
-                            case 02:  // KCC
-                                keyboardFlag = 0;
-                                AC = 0;
-                                readCharacter();
-                                break;
-                            case 04:  // KRS
-                                AC = AC | keyboardBuffer;
-                                break;
-                            case 06:  // KRB
-                                keyboardFlag = 0;
-                                readCharacter();
-                                AC = keyboardBuffer;
-                                break;
-                        }
-                        break;
-                    case 004:  // Console keyboard output
-                        switch (inst & 07) {
-                            case 00:  // TFL
-                                if (printerFlag == 0) {
-                                    printerFlag = 1;
-                                }
-                                break;
-                            case 01:  // TSF
-                                if (printerFlag) {
-                                    PC = (PC + 1) & 07777;
-                                }
-                                break;
-                            case 02:  // TCF
-                                printerFlag = 0;
-                                break;
-                            case 04:  // TPC
-                                printerBuffer = AC & 00377;
-                                printCharacter();
-                                break;
-                            case 06:  // TLS
-                                printerFlag = 0;
-                                printerBuffer = AC & 00377;
-                                printCharacter();
-                                break;
-                        }
-                        break;
-                }
-                break;
+typedef struct {
+    long long count[MEMSIZE];      // executions of each word
+    long long calls[MEMSIZE];      // JMS into each word
+    long long inclusive[MEMSIZE];  // instructions spent in calls to it
+    long long loops[MEMSIZE];      // backward jumps to each word
+    uint16 loopEnd[MEMSIZE];       // last word that jumped back to it
 
-            case OP_MICRO:
-                PC = (PC + 1) & 07777;
-
-                // Microcoded operations
-                if (I == 0) {  // Group 1
-                    // CLA CLL
-                    switch ((inst >> 6) & 00003) {
-                        case 01:  // CLL
-                            LK = 000000;
-                            break;
-                        case 02:  // CLA
-                            AC = 00000;
-                            break;
-                        case 03:  // CLA CLL
-                            AC = 00000;
-                            LK = 000000;
-                            break;
-                    }
+    Frame frames[PROFILE_DEPTH];
+    int depth;
 
-                    // CMA CML
-                    switch ((inst >> 4) & 00003) {
-                        case 01:  // CML
-                            LK = LK ^ 010000;
-                            break;
-                        case 02:  // CMA
-                            AC = AC ^ 007777;
-                            break;
-                        case 03:  // CMA CML
-                            AC = AC ^ 007777;
-                            LK = LK ^ 010000;
-                            break;
-                    }
+    // call stack tree; node 0 is the top level
+    int node;  // current call stack
+    int nodes;
+    uint16 routine[PROFILE_NODES];
+    int parent[PROFILE_NODES];
+    long long self[PROFILE_NODES];  // instructions run in this call stack
+    int hash[PROFILE_HASH];         // node + 1, or 0 for an empty slot
+} Profile;
 
-                    // IAC
-                    if (inst & 00001) {
-                        AC = (AC | LK) + 1;
-                        LK = AC & 010000;
-                        AC = AC & 007777;
-                    }
+// Monitor (-M): breakpoints, which may be on a condition of AC or the
+// link, and watchpoints on reads and writes of memory ranges, set from a
+// command prompt that ^E on the terminal, SIGINT or SIGUSR2 brings up.
+// Each kind is a bitmap of the words it covers, and pages has the kinds
+// with a word in each 128-word page. The engines only stop before words
+// stopsAt() flags, and step() only looks closer in the pages stopPages
+// marks, so a machine with nothing set runs as fast as one without.
+#define MONITOR_BREAK 0     // stop before running the word
+#define MONITOR_READ 1      // stop before an instruction reads the word
+#define MONITOR_WRITE 2     // stop before an instruction writes the word
+#define MONITOR_POINTS 64   // breakpoints, and watched ranges
+#define MONITOR_ACCESSES 4  // most words one instruction reads and writes
+#define MONITOR_KEY 005     // ^E
 
-                    // RAR RAL BSW
-                    switch ((inst >> 1) & 00007) {
-                        case 00:  // nop
-                            break;
-                        case 01:  // BSW
-                            AC = ((AC & 00077) << 6) | ((AC & 07700) >> 6);
-                            break;
-                        case 02:  // RAL
-                            AC = (AC << 1) | (LK >> 12);
-                            LK = AC & 010000;
-                            AC = AC & 007777;
-                            break;
-                        case 03:  // RTL (RAL BSW)
-                            AC = (AC << 2) | ((LK | AC) >> 11);
-                            LK = AC & 010000;
-                            AC = AC & 007777;
-                            break;
-                        case 04:  // RAR
-                            AC = ((AC | LK) >> 1) | (AC << 12);
-                            LK = AC & 010000;
-                            AC = AC & 007777;
-                            break;
-                        case 05:  // RTR (RAR BSW)
-                            AC = ((AC | LK) >> 2) | (AC << 11);
-                            LK = AC & 010000;
-                            AC = AC & 007777;
-                            break;
-                        case 06:  // RAR RAL
-                            AC = AC & inst;
-                            break;
-                        case 07:  // RAR RAL BSW
-                            break;
-                    }
-                } else {
-                    switch (inst & 00011) {
-                        case 000:  // Group 2, Or group
-                            // SMA SZA SNL
-                            switch ((inst >> 4) & 00007) {
-                                case 00:  // nop
-                                    break;
-                                case 01:  // SNL
-                                    if (LK) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 02:  // SZA
-                                    if (AC == 0) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 03:  // SZA SNL
-                                    if (AC == 0 || LK) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 04:  // SMA
-                                    // If negative (sign bit is 1)
-                                    if (AC & 04000) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 05:  // SMA SNL
-                                    if ((AC & 04000) || LK) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 06:  // SMA SZA
-                                    if ((AC & 04000) || (AC == 0)) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 07:  // SMA SZA SNL
-                                    if ((AC & 04000) || (AC == 0) || LK) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                            }
-
-                            // CLA
-                            if ((inst >> 7) & 00001) AC = 00000;
+typedef struct {
+    uint16 address;
+    char reg;      // 'a' or 'l' for a condition on AC or the link, or 0
+    uint16 value;  // what that register has to hold
+} Breakpoint;
 
-                            break;
+typedef struct {
+    uint16 first;
+    uint16 last;
+    int kinds;  // 1 << MONITOR_READ, 1 << MONITOR_WRITE
+} Watch;
 
-                        case 010:  // Group 2, And group
-                            // SPA SNA SZL
-                            switch ((inst >> 4) & 00007) {
-                                case 00:
-                                    PC = (PC + 1) & 07777;
-                                    break;
-                                case 01:  // SZL
-                                    if (LK == 0) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 02:  // SNA
-                                    if (AC) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 03:  // SNA SZL
-                                    if (AC && (LK == 0)) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 04:  // SPA
-                                    // If positive (sign bit is 0)
-                                    if ((AC & 04000) == 0) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 05:  // SPA SZL
-                                    if (((AC & 04000) == 0) && LK == 0) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 06:  // SPA SNA
-                                    if (((AC & 04000) == 0) && AC) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                                case 07:  // SPA SNA SZL
-                                    if (((AC & 04000) == 0) && AC &&
-                                        (LK == 0)) {
-                                        PC = (PC + 1) & 07777;
-                                    }
-                                    break;
-                            }
-
-                            // CLA
-                            if ((inst >> 7) & 00001) AC = 00000;
+typedef struct {
+    uint64_t words[3][MEMSIZE / 64];     // by MONITOR_*, a bit per word
+    unsigned char pages[MEMSIZE / 128];  // 1 << MONITOR_* in the page
+    Breakpoint breaks[MONITOR_POINTS];
+    int breakCount;
+    Watch watches[MONITOR_POINTS];
+    int watchCount;
+    long long stepTo;  // enter the monitor at this instruction count, or 0
+    int pass;          // run the instruction at PC before stopping again
+    FILE *tty;         // where commands come from, or NULL for stdin
+} Monitor;
 
-                            break;
+#define SENTINEL_MAX 64
 
-                        case 001:  // Group 3
-                            break;
-                        case 011:
-                            break;
-                    }
+// Device events, kept in time order so the engines only have to stop for
+// the next one instead of polling every device on every instruction. Time
+// is the machine's instruction count.
+#define EVENT_KEYBOARD 0  // keyboard reader has the next character
+#define EVENT_PRINTER 1   // printer finished the last character
+#define EVENT_FLUSH 2     // printer output has waited flushInterval
+#define EVENT_READER 3    // tape reader has the next character
+#define EVENT_PUNCH 4     // tape punch finished the last character
+#define EVENT_DISK 5      // RK8-E finished its command
+#define EVENT_DRUM 6      // RF08 finished its transfer
+#define EVENT_DEVICES 7
+
+#define KEYBOARD_DELAY 1000  // instructions from KCC/KRB to the next character
+#define KEYBOARD_POLL 10000  // instructions between polls of an idle host
+#define PRINTER_DELAY 100    // instructions to print one character
+#define READER_DELAY 10      // instructions from RFC to the next character
+#define PUNCH_DELAY 10       // instructions to punch one character
+#define PUNCH_BUFFER 65536   // punch output buffered before a write
+
+#define PRINTER_RING 4096  // printer output buffered before a write
+
+#define SLICE_MAX 1000000  // instructions between checks for signals
+
+// Speed governor: a machine with a speed runs that many times as fast as a
+// PDP-8/E with a cycleTime memory, in batches of about PACE_BATCH seconds
+// of guest time, sleeping off any lead over the host clock after each. A
+// guest more than PACE_SLACK seconds behind, because the host was slow or
+// waited for input, is not allowed to catch up in a burst.
+#define PACE_BATCH 0.01
+#define PACE_SLACK 0.1
+
+// Why run() returned early for a machine that parks instead of blocking
+#define PARK_INPUT 1   // guest waits for a character the host does not have
+#define PARK_OUTPUT 2  // host cannot take more printer output yet
+
+typedef struct {
+    long long time;  // instruction count the event is due at
+    int device;      // EVENT_*
+} Event;
+
+// One traced instruction. address, operand and pointer are only set for
+// memory reference instructions; printTrace() turns a record back into
+// the -d text.
+typedef struct {
+    uint16 pc;  // where the instruction is
+    uint16 inst;
+    uint16 ac;  // AC and link before the instruction
+    uint16 lk;
+    uint16 address;  // effective address
+    uint16 operand;  // word at address before the instruction
+    uint16 pointer;  // indirect word, before autoindexing
+    uint16 flags;    // TRACE_MODE_B; keeps records 16 bytes
+} TraceRecord;
+
+#define TRACE_MODE_B 1  // EAE was in mode B
+
+// One PDP-8: memory, registers, console devices and engine caches. All
+// execution functions take the machine they run on, so one process can
+// run any number of them.
+typedef struct Pdp8 {
+    uint16 memory[MEMSIZE];
+    uint16 AC;  // accumulator; 12 bits
+    uint16 PC;  // program counter; 12 bits
+
+    uint16 LK;  // link bit; 1 bit shifted 12 bits to the left
+
+    // KE8-E extended arithmetic element
+    uint16 MQ;        // multiplier quotient; 12 bits
+    uint16 SC;        // step counter; 5 bits
+    int eaeModeB;     // mode B, after SWAB; mode A after SWBA or CAF
+    int greaterThan;  // GT flag, set by mode B shifts and SAM
+
+    // KM8-E memory extension. Fields are held as the address of their first
+    // word. Memory is reached through the base pointers, which are kept in
+    // step with IF and DF, so a field costs nothing per access.
+    unsigned IF;       // instruction field
+    unsigned IB;       // instruction buffer, IF from the next JMP or JMS
+    unsigned DF;       // data field, for indirect operands
+    uint16 SF;         // save field: IF and DF, as octal digits, at the
+                       // last interrupt
+    int fieldPending;  // CIF or RMF waits for a JMP or JMS; interrupts wait
+    uint16 *ifMemory;  // memory + IF
+    uint16 *dfMemory;  // memory + DF
+
+    uint16 address;      // memory address
+    uint16 inst;         // instruction from memory
+    unsigned char I;     // I bit
+    unsigned char page;  // Z bit
+
+    // I/O Device
+    uint16 keyboardFlag;
+    uint16 keyboardBuffer;
+    uint16 printerFlag;
+    uint16 printerBuffer;
+    FILE *keyboard;     // where keyboard characters come from
+    FILE *printer;      // where printed characters go, by writev() on its
+                        // descriptor; never written through stdio
+    int keyboardPoll;   // keyboard is not a file; poll before reading
+    int keyboardReady;  // guest has used the keyboard, so it may be read
+    int keyboardEOF;    // keyboard input ran out
+    int lineFeeds;      // keyboard ends lines with LF or CR LF; the guest
+                        // gets CR alone
+    int lastInput;      // character the keyboard read before this one
+
+    // console callbacks of an embedding host, see pdp8.h; they take the
+    // place of keyboard and printer
+    int (*keyboardInput)(void *context);
+    void *keyboardContext;
+    void (*printerOutput)(void *context, const char *text, size_t length);
+    void *printerContext;
+
+    // keyboard log, see KEYLOG_MAGIC
+    FILE *keylog;             // characters are recorded here, or NULL
+    const unsigned char *replay;  // mapped log characters come from, or NULL
+    size_t replaySize;
+    size_t replayPosition;  // next record
+    long long keylogTime;   // instruction count of the last record
+
+    // PR8-E high-speed reader and PC8-E punch
+    const unsigned char *tape;  // reader's tape, a mapped host file, or NULL
+    size_t tapeSize;
+    size_t tapePosition;  // next character the reader reads
+    uint16 readerFlag;
+    uint16 readerBuffer;
+    uint16 punchFlag;
+    uint16 punchBuffer;
+    FILE *punch;  // where punched characters go, or NULL
+
+    // RK8-E disk controller and its drives
+    DiskImage rk[RK_DRIVES];
+    uint16 rkCommand;
+    uint16 rkStatus;
+    uint16 rkAddress;  // memory address of the next transfer
+    uint16 rkBlock;    // disk address: the block number but its high bit
+
+    // RF08 fixed-head disk
+    DiskImage rf;
+    uint16 rfStatus;
+    uint32_t rfAddress;  // disk word address of the next transfer
+    int rfDone;
+    int rfWrite;  // the transfer in progress writes the disk
+
+    // Interrupt system
+    int interruptEnable;  // ION flip-flop
+    long long enableAt;   // ION takes effect once instructions reaches this
+    int ttyInterrupts;    // console flags request interrupts (KIE)
+    int tapeInterrupts;   // reader and punch flags request interrupts (RPE)
+
+    Event events[EVENT_DEVICES];  // pending device events, soonest first
+    int eventCount;
+
+    int engine;              // ENGINE_*
+    int halted;              // guest waits for input that ran out, or
+                             // the sentinel was printed
+    int park;                // never block on the host: return from run()
+                             // with parked set instead
+    int parked;              // PARK_*, or 0
+    int attention;           // an IOT ran; engines return to run()
+    int idle;                // guest spins on a skip IOT and JMP .-1
+    long long instructions;  // instructions executed
+    long long cycles;        // memory cycles they took, see instCycles()
+    long long limit;         // stop once instructions reaches this
+    long long sliceEnd;      // engines return once instructions reaches this
+    int stopAddress;         // engines stop before running this, or -1
+    int stopped;             // an engine stopped at stopAddress, or for
+                             // the monitor
+    Monitor *monitor;        // breakpoints and watchpoints, or NULL
+    unsigned char stopPages[MEMSIZE / 128];  // step() checks for stops here
+    const char *checkpoint;  // where snapshots go, or NULL
+    long long traceFrom;     // instruction count tracing starts at
+
+    // speed governor, see PACE_BATCH
+    double speed;           // multiple of real time, or 0 for flat out
+    long long paceSlice;    // instructions per batch, at most
+    double paceStart;       // host time the guest was last in step, or 0
+    long long paceCycles;   // cycles at paceStart
+
+    // stop when the printer prints this text
+    const char *sentinel;
+    int sentinelLength;
+    char recent[SENTINEL_MAX];  // last sentinelLength characters printed
+    long long printed;          // characters printed
+
+    // printed characters not yet written; count is head - tail
+    unsigned char printerRing[PRINTER_RING];
+    unsigned printerHead;
+    unsigned printerTail;
+    long long flushInterval;
+
+    Mix *mix;  // instruction mix counted by stepSwitch(), or NULL
+    Profile *profile;  // counted by runProfiled(), or NULL
+
+    // binary trace ring mapped from a file, or NULL
+    TraceRecord *trace;
+    uint32_t traceCapacity;
+    uint64_t *traceCount;  // in the file header
+
+    DecodedInst decoded[MEMSIZE];
+    long long fused[FUSED_COUNT];  // superinstructions run, by handler
+#ifdef JIT_SUPPORTED
+    Jit jit;
+#endif
+#ifdef AOT_SUPPORTED
+    Aot aot;
+#endif
+} Machine;
+
+// Batch mode: one job per manifest line, run on a pool of threads that
+// steal each other's jobs when their own queue runs dry.
+typedef struct {
+    char image[256];   // core image
+    char input[256];   // keyboard input
+    char output[256];  // printer output
+    long long instructions;
+    double seconds;
+    const char *error;  // why the job did not run, or NULL
+} Job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;  // the owner takes from the back, thieves from the front
+    int front;
+    int back;
+} WorkQueue;
+
+static Job *batchJobs;
+static WorkQueue *batchQueues;
+static int batchThreads;
+
+static Machine *newMachine();
+static void freeMachine(Machine *m);
+static const char *loadImage(Machine *m, const char *path);
+static int saveCore(Machine *m, const char *path, int snapshot);
+static void setStopAddress(Machine *m, int address);
+static void dropTranslations(Machine *m);
+MAIN_ONLY int attachMonitor(Machine *m);
+static void mapStops(Machine *m);
+static inline int stopsAt(Machine *m, unsigned address);
+static int monitorHit(Machine *m, char *why, size_t size);
+static int monitorPass(Machine *m);
+static void monitorStep(Machine *m);
+static void monitorEnter(Machine *m, int stopped);
+static void rebaseTime(Machine *m);
+MAIN_ONLY int runZygote(Machine *m, const char *inputPath,
+                        const char *outputPath, int children);
+MAIN_ONLY int runLockstep(Machine *m, const char *inputPath, long long block,
+                          const char *reproducer);
+static void run(Machine *m);
+MAIN_ONLY void reportMix(const char *inputPath, long long instructions);
+MAIN_ONLY void reportFused(Machine *m);
+static void runProfiled(Machine *m);
+static void profileCall(Profile *p, uint16 routine, uint16 caller,
+                        long long instructions);
+static void profileIdle(Profile *p, uint16 jmp, long long iots,
+                        long long jumps);
+MAIN_ONLY int writeProfile(Machine *m, const char *prefix);
+static double now();
+MAIN_ONLY int runBatch(const char *manifest, int threads);
+#ifdef SERVER_SUPPORTED
+MAIN_ONLY int runServer(const char *address, int threads);
+#endif
+static uint16 getAddrPageZero(uint16 inst);
+static uint16 getAddrPageCurrent(Machine *m, uint16 inst);
+static inline uint16 getIndirectAddress(Machine *m, uint16 address,
+                                        TraceRecord *r);
+static uint16 asciiToOctal(char c);
+static void runSwitch(Machine *m);
+static void stepSwitch(Machine *m);
+static void runTraced(Machine *m);
+static int openTrace(Machine *m, const char *path, uint32_t records);
+static void closeTrace(Machine *m);
+static void traceInst(Machine *m, const TraceRecord *r);
+MAIN_ONLY int decodeTrace(const char *path);
+static void printTrace(const TraceRecord *r);
+static void runThreaded(Machine *m);
+static void executeIOT(Machine *m, uint16 inst);
+static int flagLoop(Machine *m);
+static void writeMemory(Machine *m, uint16 address, uint16 value);
+static inline void noteStore(Machine *m, unsigned address);
+static void stepNoting(Machine *m);
+static void operateGroup3(Machine *m, uint16 inst);
+static void attachKeyboard(Machine *m, FILE *keyboard);
+static int attachReader(Machine *m, const char *path);
+MAIN_ONLY int attachPunch(Machine *m, const char *path);
+static int attachDisks(Machine *m, int private);
+MAIN_ONLY int recordKeyboard(Machine *m, const char *path);
+MAIN_ONLY int replayKeyboard(Machine *m, const char *path);
+static const char *bootDisk(Machine *m, const char *device);
+static void scheduleEvent(Machine *m, int device, long long delay);
+static void cancelEvent(Machine *m, int device);
+static void serviceDevices(Machine *m);
+static void decodeInst(Machine *m, uint16 address);
+static void fuseInst(Machine *m, uint16 address);
+static inline void dropDecoded(Machine *m, uint16 address);
+static inline int instCycles(uint16 inst, uint16 address);
+static inline void mapFields(Machine *m);
+static uint32_t eventDelay(Machine *m, int device);
+static void takeField(Machine *m);
+static uint64_t hashMemory(const uint16 *memory);
+static int isCountLoop(const uint16 *memory, uint16 address);
+static long long countLoop(Machine *m, uint16 *pc, uint16 ea, long long budget);
+#ifdef JIT_SUPPORTED
+static int jitInit(Jit *j, uint16 *memory);
+static void jitReset(Jit *j);
+static void jitInvalidatePage(Jit *j, uint16 address);
+static void runJit(Machine *m);
+#endif
+MAIN_ONLY int aotGenerate(Machine *m, const char *path, int train);
+#ifdef AOT_SUPPORTED
+static int aotAttach(Machine *m);
+static inline void aotWrote(Machine *m, unsigned address);
+static void runAot(Machine *m);
+#endif
+static void keyboardEvent(Machine *m);
+static void logKey(Machine *m, int input);
+static void replayEvent(Machine *m);
+static void rkClear(Machine *m);
+static void rkStart(Machine *m);
+static void rkFinish(Machine *m);
+static void rfFinish(Machine *m);
+static void printCharacter(Machine *m);
+static void flushPrinter(Machine *m);
+static void readerFetch(Machine *m);
+static void punchCharacter(Machine *m);
+static void printDebug(const TraceRecord *r);
+static void printDebugMicro(uint16 inst, int modeB);
+static void printDebugGroup3(uint16 inst, int modeB);
+
+#ifndef PDP8_LIBRARY
+struct termios termios_old;
+
+void reset_termios() { tcsetattr(0, TCSANOW, &termios_old); }
+
+static void requestCheckpoint(int sig) {
+    (void)sig;
+    checkpointSignal = 1;
+}
+
+static void requestMonitor(int sig) {
+    (void)sig;
+    monitorSignal = 1;
+}
+
+int main(int argc, char **argv) {
+    char *manifest = NULL;
+    char *listenAddress = NULL;
+    char *corePath = NULL;
+    char *checkpointPath = NULL;
+    char *inputPath = NULL;
+    char *outputPath = NULL;
+    char *punchPath = NULL;
+    char *keylogPath = NULL;
+    char *aotPath = NULL;
+    char *replayPath = NULL;
+    int threads = 0;
+    int stats = 0;
+    int zygote = 0;
+    int monitor = 0;
+    long long lockstep = 0;
+    int opt;
+    while ((opt = getopt(argc, argv,
+                         "A:B:C:D:F:G:K:L:MN:P:R:ST:U:Y:b:c:de:f:i:j:k:l:n:o:p:r:s:t:x:z")) !=
+           -1) {
+        switch (opt) {
+            case 'A':  // snapshot address
+                checkpointAddress = strtol(optarg, NULL, 8) & (MEMSIZE - 1);
+                break;
+            case 'B':  // boot from a disk instead of loading an image
+                if (strcmp(optarg, "rk") != 0 && strcmp(optarg, "rf") != 0) {
+                    fprintf(stderr, "unknown boot device: %s\n", optarg);
+                    return 1;
+                }
+                bootDevice = optarg;
+                break;
+            case 'C':  // snapshot file
+                checkpointPath = optarg;
+                break;
+            case 'D':  // print a binary trace as -d text
+                return decodeTrace(optarg) ? 0 : 1;
+            case 'F':  // printer flush interval
+                flushInterval = atoll(optarg);
+                if (flushInterval < 1) flushInterval = 1;
+                break;
+            case 'G':  // translate the image to C
+                aotPath = optarg;
+                break;
+            case 'K':  // record the keyboard
+                keylogPath = optarg;
+                break;
+            case 'L':  // check the engine against the switch interpreter
+                lockstep = atoll(optarg);
+                if (lockstep < 1) lockstep = 1;
+                break;
+            case 'M':  // monitor; ^E, SIGINT or SIGUSR2 come back to it
+                monitor = 1;
+                break;
+            case 'N':  // start -d or -t at this instruction
+                traceFrom = atoll(optarg);
+                break;
+            case 'P':  // profile to prefix.lst and prefix.folded
+                profilePath = optarg;
+                break;
+            case 'R':  // paper tape for the high-speed reader
+                readerPath = optarg;
+                break;
+            case 'S':  // report speed and instruction mix
+                stats = 1;
+                break;
+            case 'T':  // run at a multiple of real time
+                speed = strcmp(optarg, "real") == 0 ? 1 : atof(optarg);
+                if (speed < 0) speed = 0;
+                break;
+            case 'U':  // memory cycle time in microseconds, for -T
+                cycleTime = atof(optarg) * 1e-6;
+                if (cycleTime <= 0) cycleTime = 1.2e-6;
+                break;
+            case 'Y':  // replay a keyboard log instead of reading input
+                replayPath = optarg;
+                break;
+            case 'b':  // batch manifest
+                manifest = optarg;
+                break;
+            case 'c':  // write the image as a binary core image
+                corePath = optarg;
+                break;
+            case 'd':  // trace every instruction
+                isDebug = 1;
+                break;
+            case 'f':  // core image
+                imagePath = optarg;
+                break;
+            case 'i':  // keyboard input file, no tty
+                inputPath = optarg;
+                break;
+            case 'k':  // the next RK05 drive
+                if (rkDrives == RK_DRIVES) {
+                    fprintf(stderr, "more than %d RK05 drives\n", RK_DRIVES);
+                    return 1;
+                }
+                rkPaths[rkDrives++] = optarg;
+                break;
+            case 'l':  // serve sessions on a socket
+                listenAddress = optarg;
+                break;
+            case 'n':  // instruction limit
+                limit = atoll(optarg);
+                break;
+            case 'o':  // printer output file
+                outputPath = optarg;
+                break;
+            case 'p':  // high-speed punch output file
+                punchPath = optarg;
+                break;
+            case 'r':  // binary trace capacity
+                traceRecords = strtoul(optarg, NULL, 10);
+                if (traceRecords < 1) traceRecords = 1;
+                break;
+            case 't':  // binary trace file
+                tracePath = optarg;
+                break;
+            case 's':  // stop on printer output
+                sentinel = optarg;
+                if (strlen(sentinel) > SENTINEL_MAX) {
+                    fprintf(stderr, "sentinel longer than %d characters\n",
+                            SENTINEL_MAX);
+                    return 1;
+                }
+                break;
+            case 'e':  // execution engine
+                if (strcmp(optarg, "switch") == 0)
+                    engine = ENGINE_SWITCH;
+                else if (strcmp(optarg, "threaded") == 0)
+                    engine = ENGINE_THREADED;
+                else if (strcmp(optarg, "jit") == 0)
+                    engine = ENGINE_JIT;
+                else if (strcmp(optarg, "aot") == 0)
+                    engine = ENGINE_AOT;
+                else {
+                    fprintf(stderr, "unknown engine: %s\n", optarg);
+                    return 1;
                 }
                 break;
+            case 'j':  // batch threads, zygote children
+                threads = atoi(optarg);
+                break;
+            case 'x':  // RF08 fixed-head disk
+                rfPath = optarg;
+                break;
+            case 'z':  // fork a child per job from the warmed-up machine
+                zygote = 1;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s [-dS] [-e switch|threaded|jit|aot] "
+                        "[-f image] "
+                        "[-i input] [-o output] [-R tape] [-p punch] "
+                        "[-k rk05]... [-x rf08] [-B rk|rf] "
+                        "[-F flush interval] "
+                        "[-T real|multiple [-U cycle us]] "
+                        "[-n instructions] [-s sentinel] "
+                        "[-b manifest [-j threads]] [-c core] [-G c file] "
+                        "[-l [host:]port|path [-j threads]] "
+                        "[-C snapshot [-A address]] [-z [-j children]] "
+                        "[-t trace [-r records]] [-D trace] [-N from] "
+                        "[-K keylog | -Y keylog] "
+                        "[-P profile] [-L block -i input [-C reproducer]] "
+                        "[-M]\n",
+                        argv[0]);
+                return 1;
         }
     }
-}
+    // only the switch interpreter has traced and profiled variants; a
+    // trace that starts later takes over from any engine
+    if (((isDebug || tracePath) && traceFrom == 0) || profilePath)
+        engine = ENGINE_SWITCH;
+#ifndef JIT_SUPPORTED
+    if (engine == ENGINE_JIT) {
+        fprintf(stderr, "no JIT for this platform, using threaded engine\n");
+        engine = ENGINE_THREADED;
+    }
+#endif
+#ifndef AOT_SUPPORTED
+    if (engine == ENGINE_AOT) {
+        fprintf(stderr,
+                "no translated images on this platform, using threaded "
+                "engine\n");
+        engine = ENGINE_THREADED;
+    }
+#endif
+
+    if (manifest) return runBatch(manifest, threads);
+    if (listenAddress) {
+#ifdef SERVER_SUPPORTED
+        return runServer(listenAddress, threads);
+#else
+        fprintf(stderr, "no server mode for this platform\n");
+        return 1;
+#endif
+    }
+
+    Machine *m = newMachine();
+    if (m == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    const char *error = bootDevice ? bootDisk(m, bootDevice)
+                                   : loadImage(m, imagePath);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", bootDevice ? bootDevice : imagePath,
+                error);
+        return 1;
+    }
+    if (corePath) return saveCore(m, corePath, 0) ? 0 : 1;
+    if (tracePath && !openTrace(m, tracePath, traceRecords)) return 1;
+    if (profilePath && (m->profile = calloc(1, sizeof(Profile))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (readerPath && !attachReader(m, readerPath)) return 1;
+    if (punchPath && !attachPunch(m, punchPath)) return 1;
+    // lockstep runs more machines on the disks, so none may write them
+    if (!attachDisks(m, lockstep != 0)) return 1;
+    if (checkpointPath) {
+        // snapshot at the address if there is one, else at the end
+        struct sigaction sa = {.sa_handler = requestCheckpoint};
+        sigaction(SIGUSR1, &sa, NULL);
+        m->checkpoint = checkpointPath;
+        setStopAddress(m, checkpointAddress);
+    }
+    if (zygote) return runZygote(m, inputPath, outputPath, threads);
+    if (lockstep && inputPath == NULL) {
+        // the reference reads the input again, so it must be a file
+        fprintf(stderr, "lockstep needs an input file\n");
+        return 1;
+    }
+    if (replayPath && !replayKeyboard(m, replayPath)) return 1;
+    FILE *keyboard = inputPath ? fopen(inputPath, "r") : stdin;
+    if (keyboard == NULL) {
+        fprintf(stderr, "cannot read %s\n", inputPath);
+        return 1;
+    }
+    if (!replayPath) attachKeyboard(m, keyboard);
+    if (keylogPath && !recordKeyboard(m, keylogPath)) return 1;
+    m->printer = outputPath ? fopen(outputPath, "w") : stdout;
+    if (m->printer == NULL) {
+        fprintf(stderr, "cannot write %s\n", outputPath);
+        return 1;
+    }
+
+    // raw mode only for a terminal; pipes and files are used as they are
+    if (inputPath == NULL && !replayPath && isatty(0)) {
+        struct termios tios;
+        tcgetattr(0, &termios_old);
+        tios = termios_old;
+        atexit(reset_termios);
+        cfmakeraw(&tios);
+        tcsetattr(0, TCSANOW, &tios);
+    }
+
+    if (aotPath) {
+        // a training run takes its input from the file, and its output
+        // goes where it would
+        int status = aotGenerate(m, aotPath, inputPath != NULL) ? 0 : 1;
+        freeMachine(m);
+        return status;
+    }
+    if (lockstep) {
+        int status = runLockstep(
+            m, inputPath, lockstep,
+            checkpointPath ? checkpointPath : "lockstep.core");
+        freeMachine(m);
+        return status;
+    }
 
-uint16 getAddrPageZero(uint16 inst) { return ((inst & 0177)); }
+    if (monitor) {
+        struct sigaction sa = {.sa_handler = requestMonitor,
+                               .sa_flags = SA_RESTART};
+        if (!attachMonitor(m)) return 1;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGUSR2, &sa, NULL);
+        monitorSignal = 1;
+    }
+
+    double start = now();
+    run(m);
+    double seconds = now() - start;
+    if (checkpointPath && checkpointAddress < 0)
+        saveCore(m, checkpointPath, 1);
+    if (m->profile && !writeProfile(m, profilePath)) return 1;
 
-uint16 getAddrPageCurrent(uint16 inst) {
-    return ((inst & 0177) | (PC & 07600));
+    if (stats) {
+        fprintf(stderr, "\n%lld instructions in %.3f s: %.2f MIPS\n",
+                m->instructions, seconds, m->instructions / seconds / 1e6);
+        double real = m->cycles * cycleTime;
+        fprintf(stderr,
+                "%lld memory cycles, %.3f s at %.1f us: %.2f times real "
+                "time\n",
+                m->cycles, real, cycleTime * 1e6, real / seconds);
+        if (m->engine == ENGINE_THREADED) reportFused(m);
+        if (inputPath) reportMix(inputPath, m->instructions);
+    }
+    freeMachine(m);
+    return 0;
 }
+#endif
 
-uint16 getIndirectAddress(uint16 address) {
-    if ((address & 07770) == 00010) {  // address 010 to 017
-        // autoindexed addressing
-        if (isDebug)
-            printf("[autoindex: address = M[%o] + 1 = %o + 1] ", address,
-                   memory[address]);
-        memory[address] = (memory[address] + 1) & 07777;
-        address = memory[address];
-    } else {
-        // immediate addressing
-        if (isDebug)
-            printf("[immediate: address = M[%o] = %o] ", address,
-                   memory[address]);
-        address = (memory[address]) & 07777;
+// A machine set up from the front end's options, or NULL if there is no
+// memory for one.
+static Machine *newMachine() {
+    Machine *m = calloc(1, sizeof(Machine));
+    if (m == NULL) return NULL;
+    m->engine = engine;
+    m->ifMemory = m->dfMemory = m->memory;
+    m->stopAddress = -1;
+    m->limit = limit;
+    m->flushInterval = flushInterval;
+    m->traceFrom = traceFrom;
+    m->ttyInterrupts = 1;
+    m->tapeInterrupts = 1;
+    if (speed > 0) {
+        m->speed = speed;
+        m->paceSlice = PACE_BATCH * speed / cycleTime;
+        if (m->paceSlice < 1) m->paceSlice = 1;
     }
-    return address;
+    if (sentinel) {
+        m->sentinel = sentinel;
+        m->sentinelLength = strlen(sentinel);
+    }
+    return m;
 }
 
-uint16 asciiToOctal(char c) {
-    uint16 ascii = (int)c;
-    return ascii - 48;
+static void freeMachine(Machine *m) {
+    if (m == NULL) return;
+    closeTrace(m);
+    free(m->profile);
+    if (m->monitor && m->monitor->tty) fclose(m->monitor->tty);
+    free(m->monitor);
+    if (m->tape) munmap((void *)m->tape, m->tapeSize);
+    if (m->replay) munmap((void *)m->replay, m->replaySize);
+    if (m->keylog) fclose(m->keylog);
+    for (int i = 0; i < RK_DRIVES; i++)
+        if (m->rk[i].words) munmap(m->rk[i].words, m->rk[i].size * 2);
+    if (m->rf.words) munmap(m->rf.words, m->rf.size * 2);
+#ifdef JIT_SUPPORTED
+    if (m->jit.buffer) munmap(m->jit.buffer, JIT_BUFSIZE);
+#endif
+#ifdef AOT_SUPPORTED
+    free(m->aot.off);
+#endif
+    free(m);
 }
 
-void readCharacter() {
-    unsigned char input;
-    scanf("%c", &input);
-    keyboardBuffer = input;
-    keyboardFlag = 1;
+// Embedding interface, see pdp8.h. Machines made here park instead of
+// blocking, and take their console from callbacks.
+Pdp8 *pdp8New(int engine) {
+    if (engine < PDP8_SWITCH || engine > PDP8_AOT) return NULL;
+    Machine *m = newMachine();
+    if (m == NULL) return NULL;
+    m->engine = engine;
+    m->park = 1;
+    m->keyboardEOF = 1;  // until there is a keyboard
+    return m;
 }
 
-void printCharacter() {
-    unsigned char ch = printerBuffer & 0177;
-    printf("%c", ch);
-    printerFlag = 1;
+void pdp8Free(Pdp8 *m) { freeMachine(m); }
+
+const char *pdp8Load(Pdp8 *m, const char *path) { return loadImage(m, path); }
+
+int pdp8Run(Pdp8 *m, long long instructions) {
+    if (m->halted) return PDP8_HALTED;
+    m->parked = 0;
+    m->limit = m->instructions + instructions;
+    run(m);
+    if (m->halted) return PDP8_HALTED;
+    return m->parked ? PDP8_INPUT : PDP8_LIMIT;
 }
 
-void printDebug() {
-    char *op;
-    unsigned char I_str = I ? 'I' : 'D';
-    unsigned char page_str = page ? 'C' : 'Z';
-    switch (inst >> 9) {
-        case OP_AND:
-            op = "OP_AND";
-            break;
-        case OP_TAD:
-            op = "OP_TAD";
+int pdp8Step(Pdp8 *m) { return pdp8Run(m, 1); }
+
+long long pdp8Instructions(Pdp8 *m) { return m->instructions; }
+
+unsigned pdp8Register(Pdp8 *m, int reg) {
+    switch (reg) {
+        case PDP8_AC:
+            return m->AC;
+        case PDP8_LINK:
+            return m->LK != 0;
+        case PDP8_PC:
+            return m->PC;
+        case PDP8_MQ:
+            return m->MQ;
+        case PDP8_IF:
+            return m->IF >> 12;
+        case PDP8_DF:
+            return m->DF >> 12;
+        case PDP8_ION:
+            return m->interruptEnable;
+    }
+    return 0;
+}
+
+void pdp8SetRegister(Pdp8 *m, int reg, unsigned value) {
+    switch (reg) {
+        case PDP8_AC:
+            m->AC = value & 07777;
             break;
-        case OP_ISZ:
-            op = "OP_ISZ";
+        case PDP8_LINK:
+            m->LK = value ? 010000 : 0;
             break;
-        case OP_DCA:
-            op = "OP_DCA";
+        case PDP8_PC:
+            m->PC = value & 07777;
+            m->idle = 0;  // it may no longer be in the loop it polled in
             break;
-        case OP_JMS:
-            op = "OP_JMS";
+        case PDP8_MQ:
+            m->MQ = value & 07777;
             break;
-        case OP_JMP:
-            op = "OP_JMP";
+        case PDP8_IF:
+            m->IF = m->IB = (value & 07) << 12;
+            m->fieldPending = 0;
+            mapFields(m);
             break;
-        case OP_IO:
-            op = "OP_IO";
+        case PDP8_DF:
+            m->DF = (value & 07) << 12;
+            mapFields(m);
             break;
-        case OP_MICRO:
-            op = "OP_MICRO";
-            I_str = '-';
-            page_str = '-';
+        case PDP8_ION:
+            m->interruptEnable = value != 0;
+            m->enableAt = m->instructions;
             break;
     }
-    printf("PC: %o, INST: %o, AC: %o, LK: %o; (%s %c %c) ", PC, inst, AC, LK,
-           op, I_str, page_str);
 }
 
-void printDebugMicro() {
-    if (inst >> 9 != OP_MICRO) return;
-    if (I == 0) {  // Group 1
-        printf("Grp 1, ");
-        // CLA CLL
-        switch ((inst >> 6) & 00003) {
-            case 01:  // CLL
-                printf("CLL ");
-                break;
-            case 02:  // CLA
-                printf("CLA ");
-                break;
-            case 03:  // CLA CLL
-                printf("CLA CLL ");
-                break;
-        }
+unsigned pdp8Read(Pdp8 *m, unsigned address) {
+    return m->memory[address & (MEMSIZE - 1)];
+}
 
-        // CMA CML
-        switch ((inst >> 4) & 00003) {
-            case 01:  // CML
-                printf("CML ");
-                break;
-            case 02:  // CMA
-                printf("CMA ");
-                break;
-            case 03:  // CMA CML
-                printf("CMA CML ");
-                break;
-        }
+void pdp8Write(Pdp8 *m, unsigned address, unsigned value) {
+    writeMemory(m, address & (MEMSIZE - 1), value & 07777);
+    m->idle = 0;
+}
 
-        // IAC
-        if (inst & 00001) {
-            printf("IAC ");
-        }
+void pdp8Keyboard(Pdp8 *m, int (*input)(void *context), void *context) {
+    m->keyboardInput = input;
+    m->keyboardContext = context;
+    m->keyboardEOF = input == NULL;
+    m->halted = 0;
+    // a guest already waiting on the keyboard reads on
+    if (input && m->keyboardReady && !m->keyboardFlag &&
+        eventDelay(m, EVENT_KEYBOARD) == NO_EVENT)
+        scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+}
 
-        // RAR RAL BSW
-        switch ((inst >> 1) & 00007) {
-            case 01:  // BSW
-                printf("BSW ");
-                break;
-            case 02:  // RAL
-                printf("RAL ");
-                break;
-            case 03:  // RTL (RAL BSW)
-                printf("RTL (RAL BSW) ");
-                break;
-            case 04:  // RAR
-                printf("RAR ");
-                break;
-            case 05:  // RTR (RAR BSW)
-                printf("RTR (RAR BSW) ");
-                break;
-            case 06:  // RAR RAL
-                printf("RAR RAL ");
-                break;
-            case 07:  // RAR RAL BSW
-                printf("RAR RAL BSW ");
-                break;
-        }
-    } else {
-        switch (inst & 00011) {
-            printf("Grp 2, or: ");
-            case 000:  // Group 2, Or group
-                // SMA SZA SNL
-                switch ((inst >> 4) & 00007) {
-                    case 00:
-                        printf("NOP ");
-                        break;
-                    case 01:  // SNL
-                        printf("SNL ");
-                        break;
-                    case 02:  // SZA
-                        printf("SZA ");
-                        break;
-                    case 03:  // SZA SNL
-                        printf("SZA SNL ");
-                        break;
-                    case 04:  // SMA
-                        // If negative (sign bit is 1)
-                        printf("SMA ");
-                        break;
-                    case 05:  // SMA SNL
-                        printf("SMA SNL ");
-                        break;
-                    case 06:  // SMA SZA
-                        printf("SMA SZA ");
-                        break;
-                    case 07:  // SMA SZA SNL
-                        printf("SMA SZA SNL ");
-                        break;
-                }
+void pdp8Printer(Pdp8 *m,
+                 void (*output)(void *context, const char *text,
+                                size_t length),
+                 void *context) {
+    flushPrinter(m);  // what was printed before goes where it was going
+    m->printerOutput = output;
+    m->printerContext = context;
+}
 
-                // CLA
-                if ((inst >> 7) & 00001) printf("CLA ");
+static unsigned get16(const unsigned char *p) { return p[0] | p[1] << 8; }
 
-                break;
+static uint32_t get32(const unsigned char *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
 
-            case 010:  // Group 2, And group
-                printf("Grp 2, and: ");
-                // SPA SNA SZL
-                switch ((inst >> 4) & 00007) {
-                    case 00:
-                        printf("unconditional skp ");
-                        break;
-                    case 01:  // SZL
-                        printf("SZL ");
-                        break;
-                    case 02:  // SNA
-                        printf("SNA ");
-                        break;
-                    case 03:  // SNA SZL
-                        printf("SNA SZL ");
-                        break;
-                    case 04:  // SPA
-                        // If positive (sign bit is 0)
-                        printf("SPA ");
-                        break;
-                    case 05:  // SPA SZL
-                        printf("SPA SZL ");
-                        break;
-                    case 06:  // SPA SNA
-                        printf("SPA SNA ");
-                        break;
-                    case 07:  // SPA SNA SZL
-                        printf("SPA SNA SZL ");
-                        break;
-                }
+static void put16(unsigned char *p, unsigned value) {
+    p[0] = value & 0377;
+    p[1] = value >> 8;
+}
 
-                // CLA
-                if ((inst >> 7) & 00001) printf("CLA ");
+static void put32(unsigned char *p, uint32_t value) {
+    put16(p, value & 0177777);
+    put16(p + 2, value >> 16);
+}
 
-                break;
+static uint32_t adler32(const unsigned char *p, size_t n) {
+    uint32_t a = 1, b = 0;
+    while (n--) {
+        a = (a + *p++) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
 
-            case 001:  // Group 3
-                printf("Grp 3 ");
-                break;
-            case 011:
-                break;
-        }
+// Instructions until device's event, or NO_EVENT.
+static uint32_t eventDelay(Machine *m, int device) {
+    for (int i = 0; i < m->eventCount; i++)
+        if (m->events[i].device == device)
+            return m->events[i].time - m->instructions;
+    return NO_EVENT;
+}
+
+static void saveState(Machine *m, unsigned char *p) {
+    put16(p, m->AC);
+    put16(p + 2, m->LK != 0);
+    put16(p + 4, (m->keyboardFlag != 0) | (m->printerFlag != 0) << 1 |
+                     m->interruptEnable << 2 | m->ttyInterrupts << 3 |
+                     m->keyboardReady << 4 | m->eaeModeB << 5 |
+                     m->greaterThan << 6);
+    put16(p + 6, m->keyboardBuffer);
+    put16(p + 8, m->printerBuffer);
+    put32(p + 10, m->interruptEnable && m->enableAt > m->instructions
+                      ? m->enableAt - m->instructions
+                      : 0);
+    put32(p + 14, eventDelay(m, EVENT_KEYBOARD));
+    put32(p + 18, eventDelay(m, EVENT_PRINTER));
+    put16(p + 22, m->MQ);
+    put16(p + 24, m->SC);
+    put16(p + 26, (m->readerFlag != 0) | (m->punchFlag != 0) << 1 |
+                      m->tapeInterrupts << 2);
+    put16(p + 28, m->readerBuffer);
+    put16(p + 30, m->punchBuffer);
+    put32(p + 32, eventDelay(m, EVENT_READER));
+    put32(p + 36, eventDelay(m, EVENT_PUNCH));
+    put32(p + 40, m->tapePosition);
+    put16(p + 44, m->rkCommand);
+    put16(p + 46, m->rkStatus);
+    put16(p + 48, m->rkAddress);
+    put16(p + 50, m->rkBlock);
+    put32(p + 52, eventDelay(m, EVENT_DISK));
+    put16(p + 56, m->rfStatus);
+    put16(p + 58, m->rfDone | m->rfWrite << 1);
+    put32(p + 60, m->rfAddress);
+    put32(p + 64, eventDelay(m, EVENT_DRUM));
+    put16(p + 68, m->IF >> 6 | m->IB >> 9 | m->DF >> 12);
+    put16(p + 70, m->SF | m->fieldPending << 6);
+}
+
+static void restoreState(Machine *m, const unsigned char *p, size_t size) {
+    unsigned flags = get16(p + 4);
+    uint32_t delay;
+
+    m->AC = get16(p) & 07777;
+    m->LK = get16(p + 2) ? 010000 : 0;
+    m->keyboardFlag = flags & 1;
+    m->printerFlag = (flags >> 1) & 1;
+    m->interruptEnable = (flags >> 2) & 1;
+    m->ttyInterrupts = (flags >> 3) & 1;
+    m->keyboardReady = (flags >> 4) & 1;
+    m->eaeModeB = (flags >> 5) & 1;
+    m->greaterThan = (flags >> 6) & 1;
+    m->keyboardBuffer = get16(p + 6) & 00377;
+    m->printerBuffer = get16(p + 8) & 00377;
+    m->enableAt = m->instructions + get32(p + 10);
+    if ((delay = get32(p + 14)) != NO_EVENT)
+        scheduleEvent(m, EVENT_KEYBOARD, delay);
+    if ((delay = get32(p + 18)) != NO_EVENT)
+        scheduleEvent(m, EVENT_PRINTER, delay);
+    if (size >= 26) {
+        m->MQ = get16(p + 22) & 07777;
+        m->SC = get16(p + 24) & 037;
     }
+    if (size >= 44) {
+        flags = get16(p + 26);
+        m->readerFlag = flags & 1;
+        m->punchFlag = (flags >> 1) & 1;
+        m->tapeInterrupts = (flags >> 2) & 1;
+        m->readerBuffer = get16(p + 28) & 00377;
+        m->punchBuffer = get16(p + 30) & 00377;
+        if ((delay = get32(p + 32)) != NO_EVENT)
+            scheduleEvent(m, EVENT_READER, delay);
+        if ((delay = get32(p + 36)) != NO_EVENT)
+            scheduleEvent(m, EVENT_PUNCH, delay);
+        m->tapePosition = get32(p + 40);
+    }
+    if (size >= 68) {
+        m->rkCommand = get16(p + 44) & 07777;
+        m->rkStatus = get16(p + 46) & 07777;
+        m->rkAddress = get16(p + 48) & 07777;
+        m->rkBlock = get16(p + 50) & 07777;
+        if ((delay = get32(p + 52)) != NO_EVENT)
+            scheduleEvent(m, EVENT_DISK, delay);
+        m->rfStatus = get16(p + 56) & 07777;
+        flags = get16(p + 58);
+        m->rfDone = flags & 1;
+        m->rfWrite = (flags >> 1) & 1;
+        m->rfAddress = get32(p + 60) & (RF_WORDS - 1);
+        if ((delay = get32(p + 64)) != NO_EVENT)
+            scheduleEvent(m, EVENT_DRUM, delay);
+    }
+    if (size >= 72) {
+        unsigned fields = get16(p + 68);
+        m->IF = (fields & 0700) << 6;
+        m->IB = (fields & 0070) << 9;
+        m->DF = (fields & 0007) << 12;
+        flags = get16(p + 70);
+        m->SF = flags & 077;
+        m->fieldPending = (flags >> 6) & 1;
+        mapFields(m);
+    }
+}
+
+static const char *loadCore(Machine *m, const unsigned char *data,
+                            size_t size) {
+    if (size < CORE_HEADER) return "truncated core image";
+    unsigned version = get16(data + 4);
+    if (version != CORE_VERSION && version != CORE_SNAPSHOT)
+        return "unknown core image version";
+
+    unsigned start = get16(data + 6);
+    uint32_t words = get32(data + 8);
+    if (words > MEMSIZE || start >= MEMSIZE) return "bad core image header";
+    const unsigned char *p = data + CORE_HEADER;
+    size_t state = 0;  // bytes of snapshot state, with its size
+    if (version == CORE_SNAPSHOT) {
+        if (size < CORE_HEADER + 2) return "truncated core image";
+        state = 2 + get16(p);
+        if (state < 2 + SNAPSHOT_STATE_MIN) return "bad snapshot state";
+    }
+    size_t packed = ((size_t)words * 3 + 1) / 2;
+    if (size != CORE_HEADER + state + packed) return "truncated core image";
+    if (adler32(p, state + packed) != get32(data + 12))
+        return "core image checksum mismatch";
+
+    m->IF = m->IB = start & 070000;
+    mapFields(m);
+    if (state) restoreState(m, p + 2, state - 2);
+    p += state;
+    uint32_t i;
+    for (i = 0; i + 1 < words; i += 2, p += 3) {
+        m->memory[i] = p[0] << 4 | p[1] >> 4;
+        m->memory[i + 1] = (p[1] & 017) << 8 | p[2];
+    }
+    if (i < words) m->memory[i] = p[0] << 4 | p[1] >> 4;
+    m->PC = start & 07777;
+    return NULL;
+}
+
+// Legacy ASCII octal dump, four digits per word from address 0. The SSE2
+// path turns 16 digits into 4 words at a time: digit pairs are combined
+// in 16-bit lanes, then pairs of pairs in 32-bit lanes.
+static const char *loadDump(Machine *m, const unsigned char *data,
+                            size_t size) {
+    while (size && (data[size - 1] == '\n' || data[size - 1] == '\r'))
+        size--;
+    if (size % 4) return "octal dump is not four digits per word";
+    size_t words = size / 4;
+    if (words > MEMSIZE) return "octal dump larger than memory";
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i seven = _mm_set1_epi8(7);
+    const __m128i low8 = _mm_set1_epi16(0x00ff);
+    const __m128i low16 = _mm_set1_epi32(0xffff);
+    for (; i + 4 <= words; i += 4) {
+        __m128i digits = _mm_sub_epi8(
+            _mm_loadu_si128((const __m128i *)(data + 4 * i)), zero);
+        __m128i over = _mm_subs_epu8(digits, seven);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128())) !=
+            0xffff)
+            return "not an octal dump";
+        __m128i pairs = _mm_add_epi16(
+            _mm_slli_epi16(_mm_and_si128(digits, low8), 3),
+            _mm_srli_epi16(digits, 8));
+        __m128i quads = _mm_add_epi32(
+            _mm_slli_epi32(_mm_and_si128(pairs, low16), 6),
+            _mm_srli_epi32(pairs, 16));
+        _mm_storel_epi64((__m128i *)&m->memory[i],
+                         _mm_packs_epi32(quads, quads));
+    }
+#endif
+    for (; i < words; i++) {
+        uint16 word = 0;
+        for (int j = 0; j < 4; j++) {
+            char c = data[4 * i + j];
+            if (c < '0' || c > '7') return "not an octal dump";
+            word = word << 3 | asciiToOctal(c);
+        }
+        m->memory[i] = word;
+    }
+    return NULL;
+}
+
+// RIM or BIN paper tape. Leader frames (0200) are skipped, an origin
+// (frames 01xxxxxx 00xxxxxx) sets the load address and a data word (frames
+// 00xxxxxx 00xxxxxx) is stored there. Field settings (11fff000) select the
+// field, and everything between two rubouts (0377) is ignored. RIM tapes
+// give an origin before every word. BIN tapes end with a checksum word,
+// the sum of every origin and data frame before it, so the last word is
+// held back until the tape shows which kind it is.
+static const char *loadTape(Machine *m, const unsigned char *data,
+                            size_t size) {
+    unsigned field = 0;
+    unsigned address = 0;
+    unsigned sum = 0;
+    unsigned sumBefore = 0;  // sum without the held-back word
+    unsigned heldAddress = 0;
+    uint16 held = 0;
+    int holding = 0;
+    int rim = 1;       // every data word so far followed an origin
+    int origin = 0;    // the last word was an origin
+    int ignore = 0;    // between rubouts
+    size_t i = 0;
+
+    while (i < size) {
+        unsigned char c = data[i];
+        if (c == 0377) {
+            ignore = !ignore;
+            i++;
+            continue;
+        }
+        if (ignore) {
+            i++;
+            continue;
+        }
+        if (c == 0200) {
+            if (holding) break;  // trailer
+            i++;
+            continue;
+        }
+        if ((c & 0300) == 0300) {
+            field = (c >> 3) & 07;
+            i++;
+            continue;
+        }
+        if (i + 1 >= size || (data[i + 1] & 0300))
+            return "paper tape frame out of place";
+        unsigned word = (c & 077) << 6 | (data[i + 1] & 077);
+        if (holding) m->memory[heldAddress] = held;
+        holding = 0;
+        if (c & 0100) {
+            address = word;
+            origin = 1;
+        } else {
+            if (!origin) rim = 0;
+            held = word;
+            heldAddress = field << 12 | address;
+            holding = 1;
+            address = (address + 1) & 07777;
+            sumBefore = sum;
+            origin = 0;
+        }
+        sum += c + data[i + 1];
+        i += 2;
+    }
+
+    if (!holding) return "no data on paper tape";
+    if (rim)
+        m->memory[heldAddress] = held;
+    else if ((sumBefore & 07777) != held)
+        return "paper tape checksum mismatch";
+    return NULL;
+}
+
+// Load an image into m and point its PC at the start address, 0200 unless
+// the image has one. Takes a binary core image, a RIM or BIN paper tape
+// (starting with leader or an origin) or a legacy ASCII octal dump. The
+// file is mapped, not read. Returns NULL, or why the image did not load.
+static const char *loadImage(Machine *m, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return "cannot open image";
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return "empty image";
+    }
+    size_t size = st.st_size;
+    const unsigned char *data =
+        mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return "cannot map image";
+
+    const char *error;
+    m->PC = 0200;  // start at address 0200 (skip page 0)
+    if (size >= 4 && memcmp(data, CORE_MAGIC, 4) == 0)
+        error = loadCore(m, data, size);
+    else if (data[0] == 0200 || (data[0] & 0300) == 0100)
+        error = loadTape(m, data, size);
+    else
+        error = loadDump(m, data, size);
+    munmap((void *)data, size);
+    // even a load that failed part way may have changed memory under code
+    // the engines decoded or translated, on a machine that already ran
+    dropTranslations(m);
+    m->idle = 0;
+    return error;
+}
+
+// Write memory up to its last nonzero word as a binary core image that
+// starts at the PC, or as a snapshot of the whole machine. The file is
+// written under a temporary name and renamed, so a reader never sees half
+// of it.
+static int saveCore(Machine *m, const char *path, int snapshot) {
+    uint32_t words = MEMSIZE;
+    while (words > 0 && m->memory[words - 1] == 0) words--;
+
+    size_t state = snapshot ? 2 + SNAPSHOT_STATE : 0;
+    size_t size = CORE_HEADER + state + ((size_t)words * 3 + 1) / 2;
+    unsigned char *data = calloc(1, size + 1);  // + the pad of an odd word
+    if (data == NULL) return 0;
+    memcpy(data, CORE_MAGIC, 4);
+    put16(data + 4, snapshot ? CORE_SNAPSHOT : CORE_VERSION);
+    put16(data + 6, m->IF | m->PC);
+    put32(data + 8, words);
+    unsigned char *p = data + CORE_HEADER;
+    if (snapshot) {
+        flushPrinter(m);  // output so far belongs to the run, not the copy
+        put16(p, SNAPSHOT_STATE);
+        saveState(m, p + 2);
+        p += state;
+    }
+    for (uint32_t i = 0; i < words; i += 2, p += 3) {
+        uint16 next = i + 1 < words ? m->memory[i + 1] : 0;
+        p[0] = m->memory[i] >> 4;
+        p[1] = (m->memory[i] & 017) << 4 | next >> 8;
+        p[2] = next & 0377;
+    }
+    put32(data + 12, adler32(data + CORE_HEADER, size - CORE_HEADER));
+
+    char temporary[1024];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *f = fopen(temporary, "wb");
+    int ok = f && fwrite(data, 1, size, f) == size;
+    if (f && fclose(f) != 0) ok = 0;
+    if (ok && rename(temporary, path) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", path);
+        unlink(temporary);
+    }
+    free(data);
+    return ok;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void countMix(Mix *mix, uint16 inst) {
+    int op = inst >> 9;
+
+    mix->opcode[op]++;
+    if (op != OP_MICRO) return;
+    if ((inst & 00400) == 0) {
+        mix->operate[0]++;
+        for (int i = 0; i < 8; i++)
+            if (inst & group1Bits[i]) mix->group1[i]++;
+    } else if ((inst & 00001) == 0) {
+        int andGroup = (inst >> 3) & 00001;
+        mix->operate[1 + andGroup]++;
+        for (int i = 0; i < 6; i++)
+            if (inst & group2Bits[i]) mix->group2[andGroup][i]++;
+    } else {
+        mix->operate[3]++;
+    }
+}
+
+static void printMixLine(const char *name, long long count, long long total) {
+    fprintf(stderr, "  %-10s %14lld %6.2f%%\n", name, count,
+            total ? 100.0 * count / total : 0.0);
+}
+
+// Run the benchmark input again on the reference interpreter, counting the
+// instruction mix, and print it. The timed run is not slowed by counting.
+static void reportMix(const char *inputPath, long long instructions) {
+    static const char *opNames[8] = {"AND", "TAD", "ISZ", "DCA",
+                                     "JMS", "JMP", "IOT", "OPR"};
+    static const char *operateNames[4] = {"group 1", "group 2 or",
+                                          "group 2 and", "group 3"};
+    Mix mix;
+    struct stat st;
+
+    memset(&mix, 0, sizeof(mix));
+    // a pipe or terminal cannot be read a second time
+    if (stat(inputPath, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "no instruction mix: %s is not a file\n", inputPath);
+        return;
+    }
+    Machine *m = newMachine();
+    if (m == NULL) {
+        fprintf(stderr, "no instruction mix: out of memory\n");
+        return;
+    }
+
+    loadImage(m, imagePath);
+    FILE *keyboard = fopen(inputPath, "r");
+    m->printer = fopen("/dev/null", "w");
+    if (keyboard == NULL || m->printer == NULL) {
+        fprintf(stderr, "cannot rerun %s for the instruction mix\n",
+                inputPath);
+        return;
+    }
+    attachKeyboard(m, keyboard);
+    m->mix = &mix;
+    m->engine = ENGINE_SWITCH;
+    run(m);
+    if (m->instructions != instructions)
+        fprintf(stderr, "warning: mix run took %lld instructions\n",
+                m->instructions);
+
+    fprintf(stderr, "opcode mix:\n");
+    for (int i = 0; i < 8; i++)
+        printMixLine(opNames[i], mix.opcode[i], m->instructions);
+    fprintf(stderr, "operate mix:\n");
+    for (int i = 0; i < 4; i++)
+        printMixLine(operateNames[i], mix.operate[i], mix.opcode[OP_MICRO]);
+    fprintf(stderr, "group 1 bits:\n");
+    for (int i = 0; i < 8; i++)
+        printMixLine(group1Names[i], mix.group1[i], mix.operate[0]);
+    for (int g = 0; g < 2; g++) {
+        fprintf(stderr, "group 2 %s bits:\n", g ? "and" : "or");
+        for (int i = 0; i < 6; i++)
+            printMixLine(group2Names[g][i], mix.group2[g][i],
+                         mix.operate[1 + g]);
+    }
+
+    fclose(m->keyboard);
+    fclose(m->printer);
+    freeMachine(m);
+}
+
+// Print how often the threaded engine ran each superinstruction, against
+// all instructions run.
+static void reportFused(Machine *m) {
+    fprintf(stderr, "superinstructions:\n");
+    for (int i = 0; i < FUSED_COUNT; i++)
+        printMixLine(fusedNames[i], m->fused[i], m->instructions);
+}
+
+typedef struct {
+    long long value;
+    uint16 address;
+} Ranked;
+
+static int byValue(const void *a, const void *b) {
+    long long x = ((const Ranked *)a)->value;
+    long long y = ((const Ranked *)b)->value;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Fill ranked with the addresses whose value is nonzero, largest first, and
+// return how many there are.
+static int rank(Ranked *ranked, const long long *values) {
+    int n = 0;
+    for (int a = 0; a < MEMSIZE; a++)
+        if (values[a]) ranked[n++] = (Ranked){values[a], a};
+    qsort(ranked, n, sizeof(Ranked), byValue);
+    return n;
+}
+
+static void listInst(FILE *f, uint16 pc, uint16 inst) {
+    static const char *opNames[8] = {"AND", "TAD", "ISZ", "DCA",
+                                     "JMS", "JMP", "IOT", "OPR"};
+    int op = inst >> 9;
+
+    if (op >= OP_IO) {
+        fprintf(f, "%s %04o", opNames[op], inst);
+        return;
+    }
+    uint16 address = (inst & 0177) | (inst & 00200 ? pc & 07600 : 0);
+    fprintf(f, "%s %s%04o", opNames[op], inst & 00400 ? "I " : "", address);
+}
+
+static double percent(long long count, long long total) {
+    return total ? 100.0 * count / total : 0.0;
+}
+
+// Write prefix.lst, a summary of the hottest routines and loops followed by
+// every executed word with its count, and prefix.folded, one line per call
+// stack for flame graph tools. Frames still open count up to now.
+static int writeProfile(Machine *m, const char *prefix) {
+    Profile *p = m->profile;
+    long long total = m->instructions;
+    char path[1024];
+
+    for (int i = 0; i < p->depth; i++)
+        p->inclusive[p->frames[i].routine] += total - p->frames[i].start;
+    p->depth = 0;
+
+    snprintf(path, sizeof(path), "%s.lst", prefix);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    Ranked ranked[MEMSIZE];
+    int n = rank(ranked, p->inclusive);
+    fprintf(f, "; %lld instructions\n;\n", total);
+    fprintf(f, "; routines by inclusive instructions\n");
+    fprintf(f, ";   routine          calls        inclusive       %%\n");
+    for (int i = 0; i < n && i < PROFILE_TOP; i++) {
+        uint16 a = ranked[i].address;
+        fprintf(f, ";      %04o %14lld %16lld %7.2f\n", a, p->calls[a],
+                p->inclusive[a], percent(p->inclusive[a], total));
+    }
+    n = rank(ranked, p->loops);
+    fprintf(f, ";\n; loops by iterations\n");
+    fprintf(f, ";   head  end       iterations     instructions       %%\n");
+    for (int i = 0; i < n && i < PROFILE_TOP; i++) {
+        uint16 a = ranked[i].address;
+        long long body = 0;
+        for (int b = a; b <= p->loopEnd[a]; b++) body += p->count[b];
+        fprintf(f, ";   %04o  %04o %16lld %16lld %7.2f\n", a, p->loopEnd[a],
+                p->loops[a], body, percent(body, total));
+    }
+    fprintf(f, ";\n; addr  word            count       %%\n");
+    int last = -2;
+    for (int a = 0; a < MEMSIZE; a++) {
+        if (p->count[a] == 0) continue;
+        if (a != last + 1) fprintf(f, "\n");
+        last = a;
+        fprintf(f, "  %04o  %04o %16lld %7.2f  ", a, m->memory[a],
+                p->count[a], percent(p->count[a], total));
+        listInst(f, a, m->memory[a]);
+        if (p->calls[a])
+            fprintf(f, "  ; %lld calls, %lld inclusive", p->calls[a],
+                    p->inclusive[a]);
+        if (p->loops[a])
+            fprintf(f, "  ; loop to here from %04o, %lld iterations",
+                    p->loopEnd[a], p->loops[a]);
+        fprintf(f, "\n");
+    }
+    int ok = fclose(f) == 0;
+
+    snprintf(path, sizeof(path), "%s.folded", prefix);
+    f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    if (p->nodes == 0) p->nodes = 1;
+    for (int node = 0; node < p->nodes; node++) {
+        if (p->self[node] == 0) continue;
+        uint16 stack[PROFILE_NODES];
+        int depth = 0;
+        for (int n = node; n != 0; n = p->parent[n])
+            stack[depth++] = p->routine[n];
+        fprintf(f, "top");
+        while (depth > 0) fprintf(f, ";%04o", stack[--depth]);
+        fprintf(f, " %lld\n", p->self[node]);
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "cannot write %s profile\n", prefix);
+    return ok;
+}
+
+// Sleep off whatever lead the guest has over the host clock at m's speed.
+static void pace(Machine *m) {
+    double t = now();
+    double ahead = m->paceStart +
+                   (m->cycles - m->paceCycles) * cycleTime / m->speed - t;
+
+    if (m->paceStart == 0 || ahead < -PACE_SLACK) {
+        m->paceStart = t;
+        m->paceCycles = m->cycles;
+    } else if (ahead > 0) {
+        struct timespec ts = {(time_t)ahead,
+                              (long)((ahead - (time_t)ahead) * 1e9)};
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) continue;
+    }
+}
+
+// Run m with its engine until it waits for keyboard input that ran out,
+// prints the sentinel, reaches its instruction limit, or parks. The engine
+// runs in slices that end at the next device event, at the instruction
+// after ION, or after an IOT; devices and interrupts are serviced between
+// slices. A trace takes over from the engine at m->traceFrom.
+static void run(Machine *m) {
+    void (*slice)(Machine *) =
+        m->engine == ENGINE_SWITCH ? runSwitch : runThreaded;
+    int traced = (isDebug || m->trace) && !m->profile;
+    if (m->profile) slice = runProfiled;
+#ifdef JIT_SUPPORTED
+    if (m->engine == ENGINE_JIT) {
+        if (m->jit.buffer || jitInit(&m->jit, m->memory))
+            slice = runJit;
+        else
+            fprintf(stderr,
+                    "cannot map JIT code buffer, using threaded engine\n");
+    }
+#endif
+#ifdef AOT_SUPPORTED
+    if (m->engine == ENGINE_AOT) {
+        if (aotAttach(m))
+            slice = runAot;
+        else
+            fprintf(stderr, "no translated image linked in, using threaded "
+                            "engine\n");
+    }
+#endif
+
+    m->paceStart = 0;  // time spent outside run() is not made up
+    while (!m->halted && !m->parked && m->instructions < m->limit) {
+        if (m->speed) pace(m);
+        if (checkpointSignal && m->checkpoint) {
+            checkpointSignal = 0;
+            saveCore(m, m->checkpoint, 1);
+        }
+        if (monitorSignal && m->monitor) {
+            monitorSignal = 0;
+            monitorEnter(m, 0);
+            continue;
+        }
+        serviceDevices(m);
+        long long end = m->limit;
+        if (m->eventCount && m->events[0].time < end)
+            end = m->events[0].time;
+        if (m->interruptEnable && m->enableAt > m->instructions &&
+            m->enableAt < end)
+            end = m->enableAt;
+        if (end - m->instructions > SLICE_MAX)
+            end = m->instructions + SLICE_MAX;
+        if (m->speed && end - m->instructions > m->paceSlice)
+            end = m->instructions + m->paceSlice;
+        if (traced && m->instructions < m->traceFrom && end > m->traceFrom)
+            end = m->traceFrom;
+        if (m->monitor && m->monitor->stepTo && end > m->monitor->stepTo)
+            end = m->monitor->stepTo;
+        // the guest is at the JMP of its loop, or at the IOT after an odd
+        // skip
+        int atJmp = m->idle && flagLoop(m);
+        uint16 jmp = atJmp ? m->PC : (m->PC + 1) & 07777;
+        uint16 iot = (jmp - 1) & 07777;
+        if (m->idle && end > m->instructions && !stopsAt(m, m->IF | jmp) &&
+            !stopsAt(m, m->IF | iot)) {
+            // nothing can set the flag the guest polls before end, so skip
+            // to it. An odd count leaves the guest at the other word of the
+            // loop, still idle, so the event due at end sees an idle guest.
+            long long skipped = end - m->instructions;
+            long long jumps = (skipped + atJmp) / 2;
+            m->instructions += skipped;
+            m->cycles += skipped;  // IOT and direct JMP
+            if (m->mix) {
+                m->mix->opcode[OP_JMP] += jumps;
+                m->mix->opcode[OP_IO] += skipped - jumps;
+            }
+            if (m->profile)
+                profileIdle(m->profile, jmp, skipped - jumps, jumps);
+            if (skipped & 1) m->PC = atJmp ? iot : jmp;
+            continue;
+        }
+        m->idle = 0;
+        m->sliceEnd = end;
+        m->attention = 0;
+        if (m->monitor && m->monitor->pass) {
+            m->monitor->pass = 0;  // leaving the monitor where it stopped
+            monitorStep(m);
+        } else if (traced && m->instructions >= m->traceFrom) {
+            runTraced(m);
+        } else {
+            slice(m);
+        }
+        if (m->stopped) {
+            m->stopped = 0;
+            if ((int)(m->IF | m->PC) == m->stopAddress) {
+                // the stop address is a one-shot snapshot trigger
+                setStopAddress(m, -1);
+                if (m->checkpoint) saveCore(m, m->checkpoint, 1);
+            } else if (!monitorPass(m)) {
+                monitorEnter(m, 1);
+            }
+        }
+        if (m->monitor && m->monitor->stepTo &&
+            m->instructions >= m->monitor->stepTo) {
+            m->monitor->stepTo = 0;
+            monitorEnter(m, 0);
+        }
+    }
+    flushPrinter(m);
+    if (m->punch) fflush(m->punch);
+}
+
+// Forget the predecoded record of the word at address, and the record of
+// the word before it in the field if that is a superinstruction that
+// includes this one.
+static inline void dropDecoded(Machine *m, uint16 address) {
+    DecodedInst *before =
+        &m->decoded[(address & 070000) | ((address - 1) & 07777)];
+
+    m->decoded[address].handler = H_DECODE;
+    if (before->handler >= H_FUSED) before->handler = H_DECODE;
+}
+
+// Stop the engines before they run the instruction at address, or nowhere
+// if address is -1. The threaded engine decodes the word to H_STOP, the JIT
+// never translates it and the switch interpreter compares the PC.
+static void setStopAddress(Machine *m, int address) {
+    if (m->stopAddress >= 0) dropDecoded(m, m->stopAddress);
+    m->stopAddress = address;
+    mapStops(m);
+    if (address < 0) return;
+    dropDecoded(m, address);
+    if (address >= 010000) return;  // only field 0 is translated
+#ifdef JIT_SUPPORTED
+    if (m->jit.buffer) jitInvalidatePage(&m->jit, address);
+#endif
+#ifdef AOT_SUPPORTED
+    if (m->aot.off && aotUnit.owner[address])
+        m->aot.off[aotUnit.owner[address] - 1] = 1;
+#endif
+}
+
+// Mark the pages step() looks closer at: the stop address's, and those
+// with breakpoints, or all of them while anything is watched, since any
+// instruction may have an operand there.
+static void mapStops(Machine *m) {
+    const Monitor *mon = m->monitor;
+
+    memset(m->stopPages, 0, sizeof(m->stopPages));
+    if (m->stopAddress >= 0) m->stopPages[m->stopAddress >> 7] = 1;
+    for (int p = 0; mon && p < MEMSIZE / 128; p++)
+        if (mon->watchCount || mon->pages[p] & 1 << MONITOR_BREAK)
+            m->stopPages[p] = 1;
+}
+
+static inline int monitorHas(const Monitor *mon, int kind, unsigned address) {
+    return mon->words[kind][address >> 6] >> (address & 077) & 1;
+}
+
+// The monitor has to look at the word at address before it runs: it has a
+// breakpoint, or, with anything watched, it may read or write a watched
+// word. Direct operands are known from the word; indirect ones, what JMS
+// stores into, which may be another field, and EAE operands are only known
+// as the instruction runs, so those always qualify.
+static int monitorSuspect(const Monitor *mon, const uint16 *memory,
+                          unsigned address) {
+    if (monitorHas(mon, MONITOR_BREAK, address)) return 1;
+    if (mon->watchCount == 0) return 0;
+
+    uint16 inst = memory[address];
+    int op = inst >> 9;
+    if (op == OP_IO) return 0;
+    if (op == OP_MICRO) return (inst & 00401) == 00401;
+    if ((inst & 00400) || op == OP_JMS) return 1;
+    if (op == OP_JMP) return 0;
+    unsigned ea = (address & 070000) | (inst & 00177) |
+                  ((inst & 00200) ? address & 07600 : 0);
+    return (mon->pages[ea >> 7] &
+            (1 << MONITOR_READ | 1 << MONITOR_WRITE)) != 0;
+}
+
+// The engines stop before the word at address, a full address: it is the
+// stop address, or the monitor has to look at it.
+static inline int stopsAt(Machine *m, unsigned address) {
+    return (int)address == m->stopAddress ||
+           (m->monitor && monitorSuspect(m->monitor, m->memory, address));
+}
+
+// Forget every predecoded and translated instruction, after the words the
+// engines stop at changed.
+static void dropTranslations(Machine *m) {
+    for (int a = 0; a < MEMSIZE; a++) m->decoded[a].handler = H_DECODE;
+#ifdef JIT_SUPPORTED
+    if (m->jit.buffer) jitReset(&m->jit);
+#endif
+#ifdef AOT_SUPPORTED
+    if (m->aot.off) aotAttach(m);
+#endif
+}
+
+// The words the instruction at PC is going to read and write, in the order
+// step() makes the accesses, into addresses and kinds (MONITOR_READ or
+// MONITOR_WRITE). Returns how many there are. An indirect operand reads
+// its pointer, which autoindexing writes too; EAE instructions read the
+// word after them, and in mode B maybe what it points at.
+static int instAccesses(Machine *m, unsigned *addresses, int *kinds) {
+    uint16 pc = m->PC;
+    uint16 inst = m->ifMemory[pc];
+    int op = inst >> 9;
+    int n = 0;
+
+#define ACCESS(kind, address) \
+    (kinds[n] = (kind), addresses[n++] = (address))
+    if (op < OP_IO) {
+        uint16 ea = (inst & 00177) | ((inst & 00200) ? pc & 07600 : 0);
+        unsigned field = m->IF;
+        if (inst & 00400) {
+            uint16 pointer = m->ifMemory[ea];
+            ACCESS(MONITOR_READ, m->IF | ea);
+            if ((ea & 07770) == 00010) {
+                ACCESS(MONITOR_WRITE, m->IF | ea);
+                pointer++;
+            }
+            ea = pointer & 07777;
+            field = m->DF;
+        }
+        if (op == OP_JMS) {
+            ACCESS(MONITOR_WRITE, (m->fieldPending ? m->IB : m->IF) | ea);
+        } else if (op != OP_JMP) {
+            if (op != OP_DCA) ACCESS(MONITOR_READ, field | ea);
+            if (op == OP_ISZ || op == OP_DCA) ACCESS(MONITOR_WRITE, field | ea);
+        }
+    } else if (op == OP_MICRO && (inst & 00401) == 00401 && inst != 07431) {
+        unsigned next = m->IF | ((pc + 1) & 07777);
+        uint16 word = m->memory[next];
+        int code = (inst >> 1) & 07;
+        if (m->eaeModeB && (inst & 00040)) code |= 010;
+        if ((code == 001 && !m->eaeModeB) || code == 002 || code == 003 ||
+            (code >= 005 && code <= 007) || code == 011 || code == 012)
+            ACCESS(MONITOR_READ, next);
+        if (m->eaeModeB && (code == 002 || code == 003 || code == 011))
+            ACCESS(MONITOR_READ, m->DF | word);
+        if (code == 011)
+            ACCESS(MONITOR_READ, m->DF | ((word + 1) & 07777));
+        if (code == 012) {
+            ACCESS(MONITOR_WRITE, m->DF | word);
+            ACCESS(MONITOR_WRITE, m->DF | ((word + 1) & 07777));
+        }
+    }
+#undef ACCESS
+    return n;
+}
+
+// Does the instruction at IF:PC stop in the monitor? It does at a
+// breakpoint whose condition holds, or if it reads or writes a watched
+// word; why says which, if it is not NULL.
+static int monitorHit(Machine *m, char *why, size_t size) {
+    const Monitor *mon = m->monitor;
+    unsigned at = m->IF | m->PC;
+
+    if (monitorHas(mon, MONITOR_BREAK, at)) {
+        for (int i = 0; i < mon->breakCount; i++) {
+            const Breakpoint *b = &mon->breaks[i];
+            if (b->address != at ||
+                (b->reg == 'a' && m->AC != b->value) ||
+                (b->reg == 'l' && (m->LK != 0) != b->value))
+                continue;
+            if (why) snprintf(why, size, "breakpoint at %05o", at);
+            return 1;
+        }
+    }
+    if (mon->watchCount == 0) return 0;
+
+    unsigned addresses[MONITOR_ACCESSES];
+    int kinds[MONITOR_ACCESSES];
+    int n = instAccesses(m, addresses, kinds);
+    for (int i = 0; i < n; i++) {
+        if (!monitorHas(mon, kinds[i], addresses[i])) continue;
+        if (why)
+            snprintf(why, size, "%s %05o",
+                     kinds[i] == MONITOR_READ ? "reads" : "writes",
+                     addresses[i]);
+        return 1;
+    }
+    return 0;
+}
+
+// Run the instruction at PC in the reference interpreter with nothing to
+// stop it, then drop the predecoded copies of the words it wrote; the
+// translated ones go as they do for any interpreted instruction.
+static void monitorStep(Machine *m) {
+    unsigned addresses[MONITOR_ACCESSES];
+    int kinds[MONITOR_ACCESSES];
+    int n = instAccesses(m, addresses, kinds);
+    Monitor *mon = m->monitor;
+    int stopAddress = m->stopAddress;
+    long long sliceEnd = m->sliceEnd;
+
+    m->monitor = NULL;
+    m->stopAddress = -1;
+    m->sliceEnd = m->instructions + 1;  // no count loop runs on past it
+    stepNoting(m);
+    m->monitor = mon;
+    m->stopAddress = stopAddress;
+    m->sliceEnd = sliceEnd;
+    for (int i = 0; i < n; i++)
+        if (kinds[i] == MONITOR_WRITE) dropDecoded(m, addresses[i]);
+}
+
+// An engine stopped before the instruction at IF:PC. Returns 0 if it is
+// the stop address or stops in the monitor; otherwise runs it and returns
+// 1, so the engine can go on.
+static int monitorPass(Machine *m) {
+    if ((int)(m->IF | m->PC) == m->stopAddress || m->monitor == NULL ||
+        monitorHit(m, NULL, 0))
+        return 0;
+    monitorStep(m);
+    return 1;
+}
+
+static void monitorMark(Monitor *mon, int kind, unsigned address) {
+    mon->words[kind][address >> 6] |= (uint64_t)1 << (address & 077);
+    mon->pages[address >> 7] |= 1 << kind;
+}
+
+// Rebuild the bitmaps from the breakpoint and watch lists, and make the
+// engines see them.
+static void monitorRebuild(Machine *m) {
+    Monitor *mon = m->monitor;
+
+    memset(mon->words, 0, sizeof(mon->words));
+    memset(mon->pages, 0, sizeof(mon->pages));
+    for (int i = 0; i < mon->breakCount; i++)
+        monitorMark(mon, MONITOR_BREAK, mon->breaks[i].address);
+    for (int i = 0; i < mon->watchCount; i++) {
+        const Watch *w = &mon->watches[i];
+        for (unsigned a = w->first; a <= w->last; a++)
+            for (int kind = MONITOR_READ; kind <= MONITOR_WRITE; kind++)
+                if (w->kinds & 1 << kind) monitorMark(mon, kind, a);
+    }
+    mapStops(m);
+    dropTranslations(m);
+}
+
+// An octal address, or a range first-last, of full addresses.
+static int parseRange(const char *text, unsigned *first, unsigned *last) {
+    char *end;
+
+    if (text == NULL) return 0;
+    *first = *last = strtoul(text, &end, 8);
+    if (end != text && *end == '-') *last = strtoul(end + 1, &end, 8);
+    return end != text && *end == 0 && *first <= *last && *last < MEMSIZE;
+}
+
+static void monitorShow(Machine *m) {
+    fprintf(stderr,
+            "%05o: %04o  AC %04o  L %o  MQ %04o  DF %o  ION %o  "
+            "%lld instructions\n",
+            m->IF | m->PC, m->ifMemory[m->PC], m->AC, m->LK >> 12, m->MQ,
+            m->DF >> 12, m->interruptEnable, m->instructions);
+}
+
+static void monitorList(const Monitor *mon) {
+    static const char *kinds[] = {"", "reads", "writes", "reads and writes"};
+
+    for (int i = 0; i < mon->breakCount; i++) {
+        const Breakpoint *b = &mon->breaks[i];
+        fprintf(stderr, "break %05o", b->address);
+        if (b->reg == 'a') fprintf(stderr, " if AC = %04o", b->value);
+        if (b->reg == 'l') fprintf(stderr, " if L = %o", b->value);
+        fprintf(stderr, "\n");
+    }
+    for (int i = 0; i < mon->watchCount; i++) {
+        const Watch *w = &mon->watches[i];
+        fprintf(stderr, "watch %05o-%05o %s\n", w->first, w->last,
+                kinds[w->kinds >> MONITOR_READ]);
+    }
+}
+
+static const char monitorHelp[] =
+    "b address [ac=value | l=value]  break before running address, if AC\n"
+    "                                or the link holds value\n"
+    "w first[-last] [r | w | rw]     watch reads or writes, writes if not "
+    "said\n"
+    "d [first[-last]]                delete breakpoints and watches there, "
+    "or all\n"
+    "l                               list breakpoints and watches\n"
+    "e first[-last]                  examine memory\n"
+    "p address value...              deposit\n"
+    "s [count]                       run count instructions, or one\n"
+    "c                               continue\n"
+    "q                               quit\n"
+    "Addresses are octal with the field: 10200 is 0200 in field 1.\n";
+
+// Carry out one monitor command. Returns 1 if the machine is to run again.
+static int monitorCommand(Machine *m, char *line) {
+    Monitor *mon = m->monitor;
+    char *command = strtok(line, " \t\n");
+    char *arg = strtok(NULL, " \t\n");
+    char *option = strtok(NULL, " \t\n");
+    unsigned first, last;
+
+    if (command == NULL) return 0;
+    if (strcmp(command, "b") == 0) {
+        Breakpoint b = {0};
+        if (!parseRange(arg, &first, &last) || first != last ||
+            (option && sscanf(option, "ac=%ho", &b.value) != 1 &&
+             sscanf(option, "l=%ho", &b.value) != 1)) {
+            fprintf(stderr, "b address [ac=value | l=value]\n");
+            return 0;
+        }
+        if (mon->breakCount == MONITOR_POINTS) {
+            fprintf(stderr, "more than %d breakpoints\n", MONITOR_POINTS);
+            return 0;
+        }
+        b.address = first;
+        if (option) b.reg = option[0];
+        b.value &= b.reg == 'l' ? 1 : 07777;
+        mon->breaks[mon->breakCount++] = b;
+        monitorRebuild(m);
+    } else if (strcmp(command, "w") == 0) {
+        Watch w = {0, 0, 1 << MONITOR_WRITE};
+        if (option && strcmp(option, "r") == 0) w.kinds = 1 << MONITOR_READ;
+        if (option && strcmp(option, "rw") == 0)
+            w.kinds |= 1 << MONITOR_READ;
+        if (!parseRange(arg, &first, &last) ||
+            (option && strcmp(option, "r") != 0 &&
+             strcmp(option, "w") != 0 && strcmp(option, "rw") != 0)) {
+            fprintf(stderr, "w first[-last] [r | w | rw]\n");
+            return 0;
+        }
+        if (mon->watchCount == MONITOR_POINTS) {
+            fprintf(stderr, "more than %d watches\n", MONITOR_POINTS);
+            return 0;
+        }
+        w.first = first;
+        w.last = last;
+        mon->watches[mon->watchCount++] = w;
+        monitorRebuild(m);
+    } else if (strcmp(command, "d") == 0) {
+        if (arg == NULL) {
+            first = 0;
+            last = MEMSIZE - 1;
+        } else if (!parseRange(arg, &first, &last)) {
+            fprintf(stderr, "d [first[-last]]\n");
+            return 0;
+        }
+        int kept = 0;
+        for (int i = 0; i < mon->breakCount; i++)
+            if (mon->breaks[i].address < first ||
+                mon->breaks[i].address > last)
+                mon->breaks[kept++] = mon->breaks[i];
+        mon->breakCount = kept;
+        kept = 0;
+        for (int i = 0; i < mon->watchCount; i++)
+            if (mon->watches[i].last < first || mon->watches[i].first > last)
+                mon->watches[kept++] = mon->watches[i];
+        mon->watchCount = kept;
+        monitorRebuild(m);
+    } else if (strcmp(command, "l") == 0) {
+        monitorList(mon);
+    } else if (strcmp(command, "e") == 0) {
+        if (!parseRange(arg, &first, &last)) {
+            fprintf(stderr, "e first[-last]\n");
+            return 0;
+        }
+        for (unsigned a = first; a <= last; a++) {
+            if (a == first || a % 8 == 0) fprintf(stderr, "%05o:", a);
+            fprintf(stderr, " %04o", m->memory[a]);
+            if (a == last || a % 8 == 7) fprintf(stderr, "\n");
+        }
+    } else if (strcmp(command, "p") == 0) {
+        if (!parseRange(arg, &first, &last) || first != last) {
+            fprintf(stderr, "p address value...\n");
+            return 0;
+        }
+        for (char *v = option; v; v = strtok(NULL, " \t\n"))
+            writeMemory(m, first++ & (MEMSIZE - 1),
+                        strtoul(v, NULL, 8) & 07777);
+    } else if (strcmp(command, "s") == 0) {
+        long long count = arg ? atoll(arg) : 1;
+        mon->stepTo = m->instructions + (count < 1 ? 1 : count);
+        return 1;
+    } else if (strcmp(command, "c") == 0) {
+        return 1;
+    } else if (strcmp(command, "q") == 0) {
+        m->halted = 1;
+        return 1;
+    } else {
+        fprintf(stderr, "%s", monitorHelp);
+    }
+    return 0;
+}
+
+// The monitor prompt, with the machine before the instruction at IF:PC:
+// stopped there by a breakpoint or watchpoint, or because the monitor was
+// asked for or a step ended. Commands are read with the terminal in cooked
+// mode until one runs the machine again, which first runs the instruction
+// it stopped at.
+static void monitorEnter(Machine *m, int stopped) {
+    Monitor *mon = m->monitor;
+    FILE *in = mon->tty ? mon->tty : stdin;
+    struct termios saved;
+    int tty = tcgetattr(fileno(in), &saved) == 0;
+    char line[256];
+
+    flushPrinter(m);
+    if (tty) {
+        struct termios cooked = saved;
+        cooked.c_iflag |= ICRNL;
+        cooked.c_oflag |= OPOST | ONLCR;
+        cooked.c_lflag |= ICANON | ECHO | ISIG;
+        tcsetattr(fileno(in), TCSANOW, &cooked);
+    }
+    mon->stepTo = 0;
+    fprintf(stderr, "\n");
+    if (stopped && monitorHit(m, line, sizeof(line)))
+        fprintf(stderr, "%s\n", line);
+    monitorShow(m);
+    for (;;) {
+        fprintf(stderr, "monitor> ");
+        if (fgets(line, sizeof(line), in) == NULL) {
+            clearerr(in);  // run on; the next ^E or signal asks again
+            fprintf(stderr, "\n");
+            break;
+        }
+        if (monitorCommand(m, line)) break;
+    }
+    mon->pass = stopped;
+    monitorSignal = 0;
+    if (tty) tcsetattr(fileno(in), TCSANOW, &saved);
+}
+
+// Give m a monitor, with nothing set, that reads its commands from the
+// terminal, or from stdin if there is none.
+static int attachMonitor(Machine *m) {
+    if ((m->monitor = calloc(1, sizeof(Monitor))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+    m->monitor->tty = fopen("/dev/tty", "r");
+    return 1;
+}
+
+// Make the current instruction count time 0, keeping pending events and
+// the ION delay where they are relative to now.
+static void rebaseTime(Machine *m) {
+    for (int i = 0; i < m->eventCount; i++)
+        m->events[i].time -= m->instructions;
+    m->enableAt -= m->instructions;
+    m->instructions = 0;
+}
+
+// Run one zygote job in a forked child, from the machine as the parent
+// left it.
+static int zygoteJob(Machine *m, const char *input, const char *output) {
+    FILE *keyboard = fopen(input, "r");
+    m->printer = fopen(output, "w");
+    if (keyboard == NULL || m->printer == NULL) {
+        printf("%s: cannot open input or output\n", input);
+        return 1;
+    }
+    rebaseTime(m);
+    m->halted = 0;
+    m->printed = 0;
+    attachKeyboard(m, keyboard);
+
+    double start = now();
+    run(m);
+    printf("%s: %lld instructions, %.3f s\n", input, m->instructions,
+           now() - start);
+    return 0;
+}
+
+static int reapJob() {
+    int status;
+    if (wait(&status) < 0) return 1;
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+// Zygote mode: warm m up on the input file, if any, until the input runs
+// out. Then read job lines (input [output], output defaults to input.out)
+// from stdin and run each in a child forked from the warm machine, which
+// shares its memory copy-on-write, with at most children running at once.
+static int runZygote(Machine *m, const char *inputPath, const char *outputPath,
+                     int children) {
+    if (inputPath) {
+        FILE *keyboard = fopen(inputPath, "r");
+        m->printer = fopen(outputPath ? outputPath : "/dev/null", "w");
+        if (keyboard == NULL || m->printer == NULL) {
+            fprintf(stderr, "cannot open %s or its output\n", inputPath);
+            return 1;
+        }
+        attachKeyboard(m, keyboard);
+        run(m);
+        fclose(keyboard);
+        fclose(m->printer);
+        m->printer = NULL;
+        if (m->checkpoint && checkpointAddress < 0)
+            saveCore(m, m->checkpoint, 1);
+    }
+    if (children <= 0) children = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int count = 0;
+    int failed = 0;
+    int running = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), stdin)) {
+        char input[256];
+        char output[256];
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+        int fields = sscanf(line, "%255s %255s", input, output);
+        if (fields <= 0) continue;
+        if (fields == 1)
+            snprintf(output, sizeof(output), "%.251s.out", input);
+
+        if (running == children) {
+            failed += reapJob();
+            running--;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            failed++;
+            continue;
+        }
+        if (pid == 0) {
+            int status = zygoteJob(m, input, output);
+            fflush(stdout);
+            _exit(status);
+        }
+        count++;
+        running++;
+    }
+    while (running > 0) {
+        failed += reapJob();
+        running--;
+    }
+    printf("%d jobs, %d failed\n", count, failed);
+    return failed ? 1 : 0;
+}
+
+// Lockstep verification: the machine's engine and the switch interpreter
+// run the same image and input side by side and are compared every block
+// instructions, registers directly and memory by hash.
+static uint64_t hashMemory(const uint16 *memory) {
+    uint64_t h = 14695981039346656037ull;  // FNV-1a, four words at a time
+    for (int i = 0; i < MEMSIZE; i += 4) {
+        uint64_t words;
+        memcpy(&words, memory + i, sizeof(words));
+        h = (h ^ words) * 1099511628211ull;
+    }
+    return h;
+}
+
+static int sameState(Machine *a, Machine *b) {
+    return a->AC == b->AC && a->LK == b->LK && a->PC == b->PC &&
+           a->IF == b->IF && a->IB == b->IB && a->DF == b->DF &&
+           a->SF == b->SF && a->fieldPending == b->fieldPending &&
+           a->MQ == b->MQ && a->SC == b->SC && a->eaeModeB == b->eaeModeB &&
+           a->greaterThan == b->greaterThan &&
+           a->keyboardFlag == b->keyboardFlag &&
+           a->printerFlag == b->printerFlag &&
+           a->readerFlag == b->readerFlag && a->punchFlag == b->punchFlag &&
+           a->tapePosition == b->tapePosition &&
+           a->interruptEnable == b->interruptEnable &&
+           a->instructions == b->instructions && a->cycles == b->cycles &&
+           a->halted == b->halted &&
+           a->printed == b->printed &&
+           hashMemory(a->memory) == hashMemory(b->memory);
+}
+
+// A machine on the image with its own reader on the input, printing
+// nowhere.
+static Machine *lockstepMachine(int engine, const char *image,
+                                const char *inputPath) {
+    Machine *m = newMachine();
+    if (m == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    FILE *keyboard = fopen(inputPath, "r");
+    m->engine = engine;
+    m->printer = fopen("/dev/null", "w");
+    if ((bootDevice ? bootDisk(m, bootDevice) : loadImage(m, image)) ||
+        keyboard == NULL || m->printer == NULL ||
+        (readerPath && !attachReader(m, readerPath)) ||
+        !attachDisks(m, 1)) {
+        fprintf(stderr, "cannot rerun %s on %s\n", image, inputPath);
+        exit(1);
+    }
+    attachKeyboard(m, keyboard);
+    return m;
+}
+
+static void closeLockstep(Machine *m) {
+    fclose(m->keyboard);
+    fclose(m->printer);
+    freeMachine(m);
+}
+
+// Run m to instruction count target, stopping at every multiple of block
+// on the way as runLockstep() does, so replays slice the same way.
+static void advance(Machine *m, long long target, long long block) {
+    while (!m->halted && m->instructions < target) {
+        m->limit = (m->instructions / block + 1) * block;
+        if (m->limit > target) m->limit = target;
+        run(m);
+    }
+}
+
+// Do fresh machines on both engines still agree after target
+// instructions?
+static int agreeAt(int engine, const char *inputPath, long long target,
+                   long long block) {
+    Machine *ref = lockstepMachine(ENGINE_SWITCH, imagePath, inputPath);
+    Machine *m = lockstepMachine(engine, imagePath, inputPath);
+    advance(ref, target, block);
+    advance(m, target, block);
+    int same = sameState(ref, m);
+    closeLockstep(ref);
+    closeLockstep(m);
+    return same;
+}
+
+static void reportDivergence(Machine *ref, Machine *m) {
+    fprintf(stderr, "        %10s %10s\n", "switch", "engine");
+    fprintf(stderr, "  PC    %10o %10o\n", ref->PC, m->PC);
+    fprintf(stderr, "  AC    %10o %10o\n", ref->AC, m->AC);
+    fprintf(stderr, "  LK    %10o %10o\n", ref->LK != 0, m->LK != 0);
+    fprintf(stderr, "  MQ    %10o %10o\n", ref->MQ, m->MQ);
+    fprintf(stderr, "  fields%10o %10o  (IF, IB, DF, SF)\n",
+            ref->IF | ref->IB >> 3 | ref->DF >> 6 | ref->SF,
+            m->IF | m->IB >> 3 | m->DF >> 6 | m->SF);
+    fprintf(stderr, "  flags %10o %10o  (keyboard, printer, ION)\n",
+            ref->keyboardFlag << 2 | ref->printerFlag << 1 |
+                ref->interruptEnable,
+            m->keyboardFlag << 2 | m->printerFlag << 1 | m->interruptEnable);
+    fprintf(stderr, "  count %10lld %10lld\n", ref->instructions,
+            m->instructions);
+    fprintf(stderr, "  cycles%10lld %10lld\n", ref->cycles, m->cycles);
+    int shown = 0;
+    for (int i = 0; i < MEMSIZE && shown < 8; i++) {
+        if (ref->memory[i] == m->memory[i]) continue;
+        fprintf(stderr, "  %05o %10o %10o\n", i, ref->memory[i],
+                m->memory[i]);
+        shown++;
+    }
+}
+
+// Write the rest of the reference's input, from where its reader has got
+// to, to path.
+static int copyRest(FILE *keyboard, const char *path) {
+    FILE *out = fopen(path, "w");
+    char buffer[4096];
+    size_t n;
+    if (out == NULL) return 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), keyboard)) > 0)
+        fwrite(buffer, 1, n, out);
+    return fclose(out) == 0;
+}
+
+// Find the first instruction after good where the engines disagree, bad
+// being a count where they are known to, and write a reproducer: a
+// snapshot of the reference at good, the input it has still to read, and
+// a binary trace of what the reference ran from there to the divergence.
+static void reproduce(Machine *m, const char *inputPath, long long good,
+                      long long bad, long long block,
+                      const char *reproducer) {
+    long long match = good;
+    while (bad - match > 1) {
+        long long middle = match + (bad - match) / 2;
+        if (agreeAt(m->engine, inputPath, middle, block))
+            match = middle;
+        else
+            bad = middle;
+    }
+    Machine *ref = lockstepMachine(ENGINE_SWITCH, imagePath, inputPath);
+    Machine *cand = lockstepMachine(m->engine, imagePath, inputPath);
+    advance(ref, bad, block);
+    advance(cand, bad, block);
+    fprintf(stderr, "first divergence after instruction %lld:\n", bad);
+    reportDivergence(ref, cand);
+    closeLockstep(ref);
+    closeLockstep(cand);
+
+    char input[1024];
+    char trace[1024];
+    snprintf(input, sizeof(input), "%s.input", reproducer);
+    snprintf(trace, sizeof(trace), "%s.trace", reproducer);
+    ref = lockstepMachine(ENGINE_SWITCH, imagePath, inputPath);
+    advance(ref, good, block);
+    long long records = bad - good;
+    if (records > traceRecords) records = traceRecords;
+    long offset = ftell(ref->keyboard);
+    if (!saveCore(ref, reproducer, 1) || !copyRest(ref->keyboard, input) ||
+        fseek(ref->keyboard, offset, SEEK_SET) != 0 ||
+        !openTrace(ref, trace, records)) {
+        fprintf(stderr, "cannot write the reproducer\n");
+        closeLockstep(ref);
+        return;
+    }
+    advance(ref, bad, block);
+    closeLockstep(ref);
+    fprintf(stderr,
+            "reproducer: -f %s -i %s -n %lld, switch interpreter trace "
+            "in %s\n",
+            reproducer, input, bad - good, trace);
+}
+
+// Lockstep mode: run m, on its own engine, and a reference machine on the
+// switch interpreter over the same image and input, comparing them every
+// block instructions. Returns 0 if they agree to the end, 1 after writing
+// a reproducer for the first divergence.
+static int runLockstep(Machine *m, const char *inputPath, long long block,
+                       const char *reproducer) {
+    Machine *ref = lockstepMachine(ENGINE_SWITCH, imagePath, inputPath);
+    long long limit = m->limit;
+    long long good = 0;  // instructions both have run and agree on
+    long long blocks = 0;
+
+    while (!ref->halted && ref->instructions < limit) {
+        long long target = (ref->instructions / block + 1) * block;
+        if (target > limit) target = limit;
+        advance(ref, target, block);
+        advance(m, target, block);
+        blocks++;
+        if (!sameState(ref, m)) {
+            fprintf(stderr, "engines disagree between instructions %lld "
+                            "and %lld\n",
+                    good, ref->instructions);
+            reproduce(m, inputPath, good, target, block, reproducer);
+            closeLockstep(ref);
+            return 1;
+        }
+        good = ref->instructions;
+    }
+    closeLockstep(ref);
+    fprintf(stderr, "engines agree over %lld instructions in %lld blocks%s\n",
+            good, blocks, m->halted ? "" : ", stopped at the limit");
+    return 0;
+}
+
+// Start up to count threads running worker, each given its index, into
+// threads. Returns how many started, having said why the next one did not.
+static int startThreads(pthread_t *threads, int count,
+                        void *(*worker)(void *)) {
+    int started = 0;
+    int error = 0;
+
+    while (started < count &&
+           (error = pthread_create(&threads[started], NULL, worker,
+                                   (void *)(intptr_t)started)) == 0)
+        started++;
+    if (error) fprintf(stderr, "cannot start thread: %s\n", strerror(error));
+    return started;
+}
+
+static void runJob(Job *job) {
+    Machine *m = newMachine();
+    job->error = m ? loadImage(m, job->image) : "out of memory";
+    if (job->error) {
+        freeMachine(m);
+        return;
+    }
+    FILE *keyboard = fopen(job->input, "r");
+    if (keyboard == NULL) {
+        job->error = "cannot read input";
+        freeMachine(m);
+        return;
+    }
+    attachKeyboard(m, keyboard);
+    m->printer = fopen(job->output, "w");
+    if (m->printer == NULL) {
+        job->error = "cannot write output";
+        fclose(m->keyboard);
+        freeMachine(m);
+        return;
+    }
+
+    double start = now();
+    run(m);
+    job->seconds = now() - start;
+    job->instructions = m->instructions;
+
+    fclose(m->keyboard);
+    fclose(m->printer);
+    freeMachine(m);
+}
+
+// Next job for worker id: its own newest job, else the oldest job of the
+// first other worker that has one. Returns -1 when every queue is empty.
+static int takeJob(int id) {
+    WorkQueue *q = &batchQueues[id];
+    int job = -1;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->back > q->front) job = q->jobs[--q->back];
+    pthread_mutex_unlock(&q->lock);
+
+    for (int i = 1; job < 0 && i < batchThreads; i++) {
+        q = &batchQueues[(id + i) % batchThreads];
+        pthread_mutex_lock(&q->lock);
+        if (q->back > q->front) job = q->jobs[q->front++];
+        pthread_mutex_unlock(&q->lock);
+    }
+    return job;
+}
+
+static void *batchWorker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    int job;
+    while ((job = takeJob(id)) >= 0) runJob(&batchJobs[job]);
+    return NULL;
+}
+
+static int runBatch(const char *manifest, int threads) {
+    FILE *f = fopen(manifest, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot read %s\n", manifest);
+        return 1;
+    }
+
+    // one job per line: image input [output]; # starts a comment
+    int count = 0;
+    int capacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        Job job = {0};
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+        int fields = sscanf(line, "%255s %255s %255s", job.image, job.input,
+                            job.output);
+        if (fields <= 0) continue;
+        if (fields == 1) {
+            fprintf(stderr, "%s: missing input for %s\n", manifest, job.image);
+            fclose(f);
+            return 1;
+        }
+        if (fields == 2)
+            snprintf(job.output, sizeof(job.output), "%.251s.out", job.input);
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Job *jobs = realloc(batchJobs, capacity * sizeof(Job));
+            if (jobs == NULL) {
+                fprintf(stderr, "out of memory\n");
+                fclose(f);
+                return 1;
+            }
+            batchJobs = jobs;
+        }
+        batchJobs[count++] = job;
+    }
+    fclose(f);
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+    batchThreads = threads;
+
+    // deal the jobs out round robin
+    batchQueues = calloc(threads, sizeof(WorkQueue));
+    if (batchQueues == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&batchQueues[i].lock, NULL);
+        batchQueues[i].jobs = malloc((count / threads + 1) * sizeof(int));
+        if (batchQueues[i].jobs == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        WorkQueue *q = &batchQueues[i % threads];
+        q->jobs[q->back++] = i;
+    }
+
+    double start = now();
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    if (workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // the workers that start take the jobs dealt to any that do not
+    int started = startThreads(workers, threads, batchWorker);
+    if (started == 0) return 1;
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    double seconds = now() - start;
+
+    int failed = 0;
+    long long total = 0;
+    for (int i = 0; i < count; i++) {
+        Job *job = &batchJobs[i];
+        if (job->error) {
+            printf("%s %s: %s\n", job->image, job->input, job->error);
+            failed++;
+            continue;
+        }
+        printf("%s %s: %lld instructions, %.3f s\n", job->image, job->input,
+               job->instructions, job->seconds);
+        total += job->instructions;
+    }
+    printf("%d jobs, %d failed, %d threads: %lld instructions, %.3f s\n",
+           count, failed, started, total, seconds);
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&batchQueues[i].lock);
+        free(batchQueues[i].jobs);
+    }
+    free(batchQueues);
+    free(workers);
+    free(batchJobs);
+    return failed ? 1 : 0;
+}
+
+#ifdef SERVER_SUPPORTED
+// Server mode: every connection to the listening socket gets a machine of
+// its own running the image, with the socket as its keyboard and printer.
+// Sessions share a few threads through one epoll instance. Registrations
+// are one-shot, so a session is on at most one thread at a time, and each
+// turn arms it again for what it waits on: input when the guest parked on
+// the keyboard, output when the socket would not take more, and output
+// too when the session used up its quantum. A socket is almost always
+// ready for output, so busy sessions take turns with everything else.
+#define SESSION_QUANTUM 5000000  // instructions a session runs per turn
+
+typedef struct {
+    Machine *m;
+    FILE *console;    // the socket, as keyboard and printer
+    long long limit;  // instruction limit of the whole session
+} Session;
+
+static int serverPoll;      // epoll instance
+static int serverListener;  // listening socket; its epoll data is NULL
+
+// Listening socket for address: a Unix socket if it has a slash, else TCP
+// on [host:]port, on the loopback interface when there is no host and on
+// every interface when the host is empty.
+static int listenOn(const char *address) {
+    int fd;
+
+    if (strchr(address, '/')) {
+        struct sockaddr_un sun = {.sun_family = AF_UNIX};
+        if (strlen(address) >= sizeof(sun.sun_path)) {
+            fprintf(stderr, "%s: socket path too long\n", address);
+            return -1;
+        }
+        strcpy(sun.sun_path, address);
+        unlink(address);  // left behind by an earlier server
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd >= 0 && (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0 ||
+                        listen(fd, SOMAXCONN) != 0)) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd < 0) perror(address);
+        return fd;
+    }
+
+    char host[256] = "127.0.0.1";
+    const char *port = strrchr(address, ':');
+    if (port) {
+        snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+        port++;
+    } else {
+        port = address;
+    }
+    struct addrinfo hints = {.ai_family = AF_UNSPEC,
+                             .ai_socktype = SOCK_STREAM,
+                             .ai_flags = AI_PASSIVE};
+    struct addrinfo *ai;
+    int error = getaddrinfo(host[0] ? host : NULL, port, &hints, &ai);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", address, gai_strerror(error));
+        return -1;
+    }
+    fd = -1;
+    for (struct addrinfo *a = ai; a && fd < 0; a = a->ai_next) {
+        int one = 1;
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK,
+                    a->ai_protocol);
+        if (fd < 0) continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(ai);
+    if (fd < 0) perror(address);
+    return fd;
+}
+
+static void armSession(Session *s, uint32_t events) {
+    struct epoll_event e = {.events = events | EPOLLONESHOT, .data.ptr = s};
+    epoll_ctl(serverPoll, EPOLL_CTL_MOD, fileno(s->console), &e);
+}
+
+// Output still in the ring is written if the socket takes it; closing the
+// socket also takes it out of the epoll instance.
+static void closeSession(Session *s) {
+    flushPrinter(s->m);
+    fclose(s->console);
+    freeMachine(s->m);
+    free(s);
+}
+
+// Start a session on a newly connected socket: a fresh machine with the
+// image loaded, to run its first turn as soon as the socket is writable.
+static void openSession(int fd) {
+    Machine *m = newMachine();
+    const char *error = m ? loadImage(m, imagePath) : "out of memory";
+    FILE *console = NULL;
+    Session *s = NULL;
+
+    if (error == NULL && fcntl(fd, F_SETFL, O_NONBLOCK) == 0 &&
+        (console = fdopen(fd, "r+")) != NULL)
+        s = malloc(sizeof(Session));
+    if (s == NULL) {
+        fprintf(stderr, "cannot start session: %s\n",
+                error ? error : strerror(errno));
+        if (console) fclose(console);
+        else close(fd);
+        freeMachine(m);
+        return;
+    }
+    s->m = m;
+    s->console = console;
+    s->limit = m->limit;
+    attachKeyboard(m, console);
+    m->printer = console;
+    m->park = 1;
+    m->lineFeeds = 1;  // clients send LF or CR LF, FOCAL wants CR
+
+    struct epoll_event e = {.events = EPOLLOUT | EPOLLONESHOT, .data.ptr = s};
+    if (epoll_ctl(serverPoll, EPOLL_CTL_ADD, fd, &e) != 0) closeSession(s);
+}
+
+static void acceptSessions() {
+    int fd;
+    while ((fd = accept(serverListener, NULL, NULL)) >= 0) openSession(fd);
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        perror("accept");
+    struct epoll_event e = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = NULL};
+    epoll_ctl(serverPoll, EPOLL_CTL_MOD, serverListener, &e);
+}
+
+// Run a session for up to SESSION_QUANTUM instructions, or until it
+// parks, and arm it for what it waits on. A session ends when its guest
+// waits for input after the client closed, or at the instruction limit.
+static void sessionTurn(Session *s, uint32_t events) {
+    Machine *m = s->m;
+    int parked = m->parked;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        closeSession(s);
+        return;
+    }
+    m->parked = 0;
+    if (parked == PARK_OUTPUT) flushPrinter(m);
+    if (!m->parked) {
+        m->limit = m->instructions + SESSION_QUANTUM;
+        if (m->limit > s->limit) m->limit = s->limit;
+        run(m);
+    }
+    if (m->halted || m->instructions >= s->limit) {
+        closeSession(s);
+        return;
+    }
+    armSession(s, m->parked == PARK_INPUT ? EPOLLIN : EPOLLOUT);
+}
+
+// Take one event at a time, so an idle thread never waits while another
+// works through a backlog of turns.
+static void *serverWorker(void *arg) {
+    struct epoll_event e;
+
+    (void)arg;
+    for (;;) {
+        int n = epoll_wait(serverPoll, &e, 1, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("epoll_wait");
+            return NULL;
+        }
+        if (e.data.ptr == NULL)
+            acceptSessions();
+        else
+            sessionTurn(e.data.ptr, e.events);
+    }
+}
+
+// Serve sessions on address (see listenOn()) with a pool of threads, one
+// per processor unless threads says otherwise. Returns only on failure.
+static int runServer(const char *address, int threads) {
+    Machine *m = newMachine();
+    const char *error = m ? loadImage(m, imagePath) : "out of memory";
+    freeMachine(m);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", imagePath, error);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);  // a client that went away is an EPIPE
+    serverListener = listenOn(address);
+    if (serverListener < 0) return 1;
+    serverPoll = epoll_create1(0);
+    struct epoll_event e = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = NULL};
+    if (serverPoll < 0 ||
+        epoll_ctl(serverPoll, EPOLL_CTL_ADD, serverListener, &e) != 0) {
+        perror("epoll");
+        return 1;
+    }
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    fprintf(stderr, "serving %s on %s, %d threads\n", imagePath, address,
+            threads);
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    if (workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    int started = startThreads(workers, threads, serverWorker);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    return 1;
+}
+#endif
+
+// Operate instructions of groups 1 and 2 decoded at compile time: an entry
+// for each of the 512 encodings, by the low nine bits, so running one is
+// a table lookup and straight-line arithmetic on link:AC as a 13-bit value.
+// Group 1 keeps the bits CLA and CLL leave, complements those of CMA and
+// CML, adds IAC, rotates, then swaps for BSW; RAR RAL ANDs AC with the
+// instruction. Group 2 skips if a condition in skipMask holds, the sense
+// inverted for the AND group, and clears AC for CLA. Group 3 encodings
+// have entries that are never used.
+typedef struct {
+    uint16 keep;               // link:AC bits CLA and CLL leave
+    uint16 flip;               // link:AC bits CMA and CML complement
+    uint16 mask;               // link:AC bits kept after the rotation
+    unsigned char iac;         // added after the complement
+    unsigned char rotate;      // left rotation of link:AC: 0, 1, 2, 11, 12
+    unsigned char bsw;         // swap the halves of AC after the rotation
+    unsigned char rotateBits;  // RAR RAL BSW as written, for printing
+    unsigned char skipMask;    // SMA or SPA 4, SZA or SNA 2, SNL or SZL 1
+    unsigned char skipSense;   // 1 for the AND group: skip unless one holds
+} Operate;
+
+#define OPR_GROUP2(i) ((i) & 0400)
+#define OPR_ROTATE_BITS(i) (OPR_GROUP2(i) ? 0 : ((i) >> 1) & 07)
+#define OPR_ENTRY(i)                                                         \
+    {(OPR_GROUP2(i) || !((i) & 0100) ? 010000 : 0) |                         \
+         ((i) & 0200 ? 0 : 07777),                                           \
+     OPR_GROUP2(i) ? 0                                                       \
+                   : ((i) & 0040 ? 07777 : 0) | ((i) & 0020 ? 010000 : 0),   \
+     OPR_ROTATE_BITS(i) == 06 ? 017000 | (i) : 017777,                       \
+     OPR_GROUP2(i) ? 0 : (i) & 0001,                                         \
+     OPR_ROTATE_BITS(i) == 02   ? 1                                          \
+     : OPR_ROTATE_BITS(i) == 03 ? 2                                          \
+     : OPR_ROTATE_BITS(i) == 04 ? 12                                         \
+     : OPR_ROTATE_BITS(i) == 05 ? 11                                         \
+                                : 0,                                         \
+     OPR_ROTATE_BITS(i) == 01,                                               \
+     OPR_ROTATE_BITS(i),                                                     \
+     OPR_GROUP2(i) ? ((i) >> 4) & 07 : 0,                                    \
+     OPR_GROUP2(i) ? ((i) >> 3) & 01 : 0}
+#define OPR_ENTRIES2(i) OPR_ENTRY(i), OPR_ENTRY((i) + 1)
+#define OPR_ENTRIES8(i)                                                      \
+    OPR_ENTRIES2(i), OPR_ENTRIES2((i) + 2), OPR_ENTRIES2((i) + 4),           \
+        OPR_ENTRIES2((i) + 6)
+#define OPR_ENTRIES64(i)                                                     \
+    OPR_ENTRIES8(i), OPR_ENTRIES8((i) + 010), OPR_ENTRIES8((i) + 020),       \
+        OPR_ENTRIES8((i) + 030), OPR_ENTRIES8((i) + 040),                    \
+        OPR_ENTRIES8((i) + 050), OPR_ENTRIES8((i) + 060),                    \
+        OPR_ENTRIES8((i) + 070)
+
+static const Operate operates[512] = {
+    OPR_ENTRIES64(0000), OPR_ENTRIES64(0100), OPR_ENTRIES64(0200),
+    OPR_ENTRIES64(0300), OPR_ENTRIES64(0400), OPR_ENTRIES64(0500),
+    OPR_ENTRIES64(0600), OPR_ENTRIES64(0700)};
+
+// Operate group 1: CLA CLL, then CMA CML, then IAC, then the rotates.
+static inline void operateGroup1(uint16 inst, uint16 *ac, uint16 *lk) {
+    const Operate *o = &operates[inst & 00777];
+    unsigned v = ((*ac | *lk) & o->keep) ^ o->flip;
+
+    v = (v + o->iac) & 017777;
+    v = ((v << o->rotate) | (v >> (13 - o->rotate))) & o->mask;
+    if (o->bsw) v = (v & 010000) | (v & 00077) << 6 | (v >> 6 & 00077);
+    *ac = v & 007777;
+    *lk = v & 010000;
+}
+
+// Operate group 2: returns 1 if the next instruction is to be skipped. The
+// skip condition is sampled before CLA.
+static inline int operateGroup2(uint16 inst, uint16 *ac, uint16 LK) {
+    const Operate *o = &operates[inst & 00777];
+    uint16 AC = *ac;
+    int holds = (AC >> 9 & 04) | (AC == 0) << 1 | LK >> 12;
+
+    *ac = AC & o->keep;
+    return ((holds & o->skipMask) != 0) ^ o->skipSense;
+}
+
+// The word after an EAE instruction, which PC points at, skipping it.
+static uint16 eaeWord(Machine *m) {
+    uint16 word = m->ifMemory[m->PC];
+    m->PC = (m->PC + 1) & 07777;
+    m->cycles++;
+    return word;
+}
+
+// MUY and DVI operand: the next word in mode A, the word it points to in
+// the data field in mode B.
+static uint16 eaeOperand(Machine *m) {
+    uint16 word = eaeWord(m);
+    m->cycles += m->eaeModeB;
+    return m->eaeModeB ? m->dfMemory[word] : word;
+}
+
+// Number of NMI shifts for AC:MQ in v: until AC0 and AC1 differ or the
+// bits below them are all zero.
+static int normalizeShifts(uint32_t v) {
+    if ((v & 017777777) == 0) return 0;
+    uint32_t differ = (v ^ (v << 1)) & 077777776;  // bit k: v_k != v_k-1
+    int shifts = 22 - __builtin_ctz(v);
+    if (differ && 23 - (31 - __builtin_clz(differ)) < shifts)
+        shifts = 23 - (31 - __builtin_clz(differ));
+    return shifts;
+}
+
+// Group 3 operate: the KE8-E extended arithmetic element. PC is past the
+// instruction; instructions with an operand take the next word and skip
+// it. Every operation, including the multiply, divide and shifts of
+// any length, is a single host operation. The memory cycles counted for
+// the operand words, and the extra cycles of the multiply, divide and
+// shifts, are close to the KE8-E's times, not exact.
+static void operateGroup3(Machine *m, uint16 inst) {
+    uint16 mq = m->MQ;
+    int code = (inst >> 1) & 07;
+    int shift;
+    uint32_t v;
+
+    // CLA, then MQL and MQA, which together swap AC and MQ
+    if (inst & 00200) m->AC = 0;
+    if (inst & 00020) {
+        m->MQ = m->AC;
+        m->AC = 0;
+    }
+    if (inst & 00100) m->AC |= mq;
+    if (inst == 07431) {  // SWAB
+        m->eaeModeB = 1;
+        return;
+    }
+    if (!m->eaeModeB) {
+        m->greaterThan = 0;
+        if (inst & 00040) m->AC |= m->SC;  // SCA
+    } else if (inst & 00040) {
+        code |= 010;  // mode B has eight more instructions
+    }
+
+    switch (code) {
+        case 000:  // NOP
+            break;
+        case 001:
+            if (m->eaeModeB) {  // ACS
+                m->SC = m->AC & 037;
+                m->AC = 0;
+            } else {  // SCL
+                m->SC = ~eaeWord(m) & 037;
+            }
+            break;
+        case 002:  // MUY: AC:MQ = MQ * operand + AC
+            v = (uint32_t)m->MQ * eaeOperand(m) + m->AC;
+            m->cycles += 5;
+            m->AC = (v >> 12) & 07777;
+            m->MQ = v & 07777;
+            m->LK = 0;
+            m->SC = 014;
+            break;
+        case 003:  // DVI: MQ = AC:MQ / operand, AC = remainder
+            shift = eaeOperand(m);  // the divisor
+            m->cycles += 5;
+            if (m->AC >= shift) {  // overflow, or divide by zero
+                m->LK = 010000;
+                m->MQ = ((m->MQ << 1) + 1) & 07777;
+                m->SC = 0;
+            } else {
+                v = (uint32_t)m->AC << 12 | m->MQ;
+                m->MQ = v / shift;
+                m->AC = v % shift;
+                m->LK = 0;
+                m->SC = 015;
+            }
+            break;
+        case 004:  // NMI
+            v = (uint32_t)m->AC << 12 | m->MQ;
+            shift = normalizeShifts(v);
+            m->cycles += shift / 4;
+            if (shift) m->LK = (m->AC & 04000) ? 010000 : 0;
+            v <<= shift;
+            m->AC = (v >> 12) & 07777;
+            m->MQ = v & 07777;
+            m->SC = shift;
+            if (m->eaeModeB && m->AC == 04000 && m->MQ == 0) m->AC = 0;
+            break;
+        case 005:  // SHL: link gets the last bit out of AC
+        case 006:  // ASR: sign extended, link gets the sign
+        case 007:  // LSR: link cleared
+            shift = (eaeWord(m) & 037) + !m->eaeModeB;
+            m->cycles += shift / 4;
+            v = (uint32_t)m->AC << 12 | m->MQ;
+            if (code == 005) {
+                uint64_t t = ((uint64_t)(m->LK | m->AC) << 12 | m->MQ)
+                             << shift;
+                m->LK = (t >> 12) & 010000;
+                v = t;
+            } else {
+                int64_t t = code == 006 && (m->AC & 04000)
+                                ? (int64_t)v - (1 << 24)
+                                : (int64_t)v;
+                if (m->eaeModeB && shift)
+                    m->greaterThan = (t >> (shift - 1)) & 1;
+                m->LK = code == 006 && (m->AC & 04000) ? 010000 : 0;
+                v = t >> shift;
+            }
+            m->AC = (v >> 12) & 07777;
+            m->MQ = v & 07777;
+            m->SC = m->eaeModeB ? 037 : 0;
+            break;
+        case 010:  // SCA
+            m->AC |= m->SC;
+            break;
+        case 011:  // DAD: AC:MQ += the double word operand points at
+            shift = eaeWord(m);  // the address, in the data field
+            m->cycles += 2;
+            v = m->MQ + m->dfMemory[shift];
+            v = (m->AC + m->dfMemory[(shift + 1) & 07777] + (v >> 12)) << 12 |
+                (v & 07777);
+            m->LK = (v >> 12) & 010000;
+            m->AC = (v >> 12) & 07777;
+            m->MQ = v & 07777;
+            break;
+        case 012:  // DST: store AC:MQ at the operand address
+            shift = eaeWord(m);
+            m->cycles += 2;
+            writeMemory(m, m->DF | shift, m->MQ);
+            writeMemory(m, m->DF | ((shift + 1) & 07777), m->AC);
+            break;
+        case 013:  // SWBA
+            m->eaeModeB = 0;
+            m->greaterThan = 0;
+            break;
+        case 014:  // DPSZ
+            if (m->AC == 0 && m->MQ == 0) m->PC = (m->PC + 1) & 07777;
+            break;
+        case 015:  // DPIC, after the swap in its MQL MQA bits
+            v = (m->AC + 1) & 07777;
+            m->AC = m->MQ + (v == 0);
+            m->MQ = v;
+            m->LK = m->AC & 010000;
+            m->AC &= 07777;
+            break;
+        case 016:  // DCM, after the swap in its MQL MQA bits
+            v = -m->AC & 07777;
+            m->AC = (m->MQ ^ 07777) + (v == 0);
+            m->MQ = v;
+            m->LK = m->AC & 010000;
+            m->AC &= 07777;
+            break;
+        case 017:  // SAM: AC = MQ - AC, GT if MQ >= AC signed
+            v = m->AC;
+            m->greaterThan = (v <= m->MQ) ^ ((v ^ m->MQ) >> 11);
+            m->AC = m->MQ + (v ^ 07777) + 1;
+            m->LK = m->AC & 010000;
+            m->AC &= 07777;
+            break;
+    }
+}
+
+// Point the field base pointers at IF and DF after either changed.
+static inline void mapFields(Machine *m) {
+    m->ifMemory = m->memory + m->IF;
+    m->dfMemory = m->memory + m->DF;
+}
+
+// A JMP or JMS after CIF or RMF: the instruction field becomes the one they
+// set up, and interrupts are let in again, so the slice ends for run() to
+// take one that was held off.
+static void takeField(Machine *m) {
+    m->IF = m->IB;
+    m->ifMemory = m->memory + m->IF;
+    m->fieldPending = 0;
+    m->attention = 1;
+}
+
+// Memory cycles the instruction inst at address takes on a PDP-8/E: the
+// fetch; a defer cycle for an indirect operand, and one more to write an
+// autoindex register back; an execute cycle for everything but JMP, IOT
+// and operate instructions, and one more for ISZ to write the incremented
+// word back. Group 3 adds the cycles of its longer operations itself.
+static inline int instCycles(uint16 inst, uint16 address) {
+    int op = inst >> 9;
+    if (op >= OP_IO) return 1;
+
+    int cycles = op == OP_JMP ? 1 : op == OP_ISZ ? 3 : 2;
+    if (inst & 00400) {
+        uint16 pointer = (inst & 0177) | ((inst & 0200) ? address & 07600 : 0);
+        cycles += (pointer & 07770) == 00010 ? 2 : 1;
+    }
+    return cycles;
+}
+
+// Execute the single instruction at PC. The core is built twice from this:
+// stepSwitch() passes r as NULL, so every trace branch folds away, and
+// stepTraced() has it filled in and handed to traceInst().
+static inline __attribute__((always_inline)) void step(Machine *m,
+                                                       TraceRecord *r) {
+    if (m->stopPages[(m->IF | m->PC) >> 7] &&
+        ((int)(m->IF | m->PC) == m->stopAddress ||
+         (m->monitor && monitorHit(m, NULL, 0)))) {
+        m->stopped = 1;
+        m->attention = 1;
+        return;
+    }
+    m->instructions++;
+
+    // fetch instruction from memory
+    m->address = m->PC;
+    m->inst = m->ifMemory[m->address];
+    m->cycles += instCycles(m->inst, m->PC);
+
+    // decode instruction
+    m->I = (m->inst >> 8) & 00001;
+    m->page = (m->inst >> 7) & 00001;
+
+    if (m->mix) countMix(m->mix, m->inst);
+
+    if (r) {
+        r->pc = m->PC;
+        r->inst = m->inst;
+        r->ac = m->AC;
+        r->lk = m->LK;
+    }
+
+    // do operation; direct operands are in the instruction field and
+    // indirect ones in the data field
+    uint16 *operand = m->ifMemory;
+    switch ((m->inst >> 9) & 07) {
+        case OP_AND:
+            // AND the operand into AC.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+
+            m->PC = (m->PC + 1) & 07777;
+            if (m->I == INDIRECT) {
+                m->address = getIndirectAddress(m, m->address, r);
+                operand = m->dfMemory;
+            }
+            if (r) {
+                r->address = m->address;
+                r->operand = operand[m->address];
+            }
+
+            m->AC = m->AC & operand[m->address];
+            break;
+
+        case OP_TAD:
+            // ADD the operand to AC.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+
+            m->PC = (m->PC + 1) & 07777;
+            if (m->I == INDIRECT) {
+                m->address = getIndirectAddress(m, m->address, r);
+                operand = m->dfMemory;
+            }
+            if (r) {
+                r->address = m->address;
+                r->operand = operand[m->address];
+            }
+
+            m->AC = (m->AC | m->LK) + operand[m->address];
+            m->LK = m->AC & 010000;
+            m->AC = m->AC & 007777;
+            break;
+
+        case OP_ISZ:
+            // Increment operand. If zero, SKIP next instruction.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+
+            int autoindex =
+                (m->I == INDIRECT) && (m->address & 07770) == 00010;
+            m->PC = (m->PC + 1) & 07777;
+            if (m->I == INDIRECT) {
+                m->address = getIndirectAddress(m, m->address, r);
+                operand = m->dfMemory;
+            }
+            if (r) {
+                r->address = m->address;
+                r->operand = operand[m->address];
+            }
+
+            // ISZ; JMP .-1 delay loop: run as much of it as the slice
+            // allows at once, unless every step is being traced
+            if (!r && !autoindex) {
+                uint16 pc = (m->PC - 1) & 07777;
+                long long ran =
+                    countLoop(m, &pc, operand - m->memory + m->address,
+                              m->sliceEnd - m->instructions + 1);
+                if (ran) {
+                    m->instructions += ran - 1;
+                    m->PC = pc;
+                    if (m->mix) {
+                        m->mix->opcode[OP_ISZ] += (ran + 1) / 2 - 1;
+                        m->mix->opcode[OP_JMP] += ran / 2;
+                    }
+                    break;
+                }
+            }
+
+            uint16 buf = operand[m->address] =
+                ((operand[m->address] + 1) & 07777);
+            if (buf == 0) m->PC = (m->PC + 1) & 07777;
+            break;
+
+        case OP_DCA:
+            // Put accumulator into memory.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+
+            m->PC = (m->PC + 1) & 07777;
+            if (m->I == INDIRECT) {
+                m->address = getIndirectAddress(m, m->address, r);
+                operand = m->dfMemory;
+            }
+            if (r) {
+                r->address = m->address;
+                r->operand = operand[m->address];
+            }
+
+            operand[m->address] = m->AC;
+            m->AC = 0;
+            break;
+
+        case OP_JMS:
+            // Store return address then JUMP to subroutine.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+            if (m->I == INDIRECT)
+                m->address = getIndirectAddress(m, m->address, r);
+            if (r) r->address = m->address;
+
+            if (m->fieldPending) takeField(m);
+            m->address = (m->address & 07777);
+            m->ifMemory[m->address] = (m->PC + 1) & 07777;
+            m->PC = (m->address + 1) & 07777;
+            break;
+
+        case OP_JMP:
+            // JUMP to address.
+            if (m->page == CURRENT)
+                m->address = getAddrPageCurrent(m, m->inst);
+            else
+                m->address = getAddrPageZero(m->inst);
+            if (m->I == INDIRECT)
+                m->address = getIndirectAddress(m, m->address, r);
+            if (r) r->address = m->address;
+
+            if (m->fieldPending) takeField(m);
+            m->PC = m->address & 07777;
+            break;
+
+        case OP_IO:  // Input/Output Transfer
+            m->PC = (m->PC + 1) & 07777;
+            if (r) traceInst(m, r);  // ahead of anything the IOT prints
+            executeIOT(m, m->inst);
+            return;
+
+        case OP_MICRO:
+            m->PC = (m->PC + 1) & 07777;
+
+            // Microcoded operations
+            if (m->I == 0) {  // Group 1
+                operateGroup1(m->inst, &m->AC, &m->LK);
+            } else if ((m->inst & 00001) == 0) {  // Group 2
+                if (operateGroup2(m->inst, &m->AC, m->LK))
+                    m->PC = (m->PC + 1) & 07777;
+            } else {  // Group 3
+                if (r && m->eaeModeB) r->flags = TRACE_MODE_B;
+                operateGroup3(m, m->inst);
+            }
+            break;
+    }
+    if (r) traceInst(m, r);
+}
+
+static void stepSwitch(Machine *m) { step(m, NULL); }
+
+static void stepTraced(Machine *m) {
+    TraceRecord r = {0};
+    step(m, &r);
+}
+
+// Reference interpreter: fetches and decodes every instruction from scratch.
+static void runSwitch(Machine *m) {
+    while (!m->attention && m->instructions < m->sliceEnd) stepSwitch(m);
+}
+
+// The reference interpreter with every instruction traced, for -d and -t.
+static void runTraced(Machine *m) {
+    while (!m->attention && m->instructions < m->sliceEnd) stepTraced(m);
+}
+
+// Node for routine called from the call stack parent, made on first use.
+// Past PROFILE_NODES stacks new callees are charged to their caller.
+static int stackNode(Profile *p, int parent, uint16 routine) {
+    uint32_t key = (uint32_t)parent << 12 | routine;
+    unsigned h = (key * 2654435761u) % PROFILE_HASH;
+    while (p->hash[h]) {
+        int n = p->hash[h] - 1;
+        if (p->parent[n] == parent && p->routine[n] == routine) return n;
+        h = (h + 1) % PROFILE_HASH;
+    }
+    if (p->nodes == PROFILE_NODES) return parent;
+    int n = p->nodes++;
+    p->parent[n] = parent;
+    p->routine[n] = routine;
+    p->hash[h] = n + 1;
+    return n;
+}
+
+// Close frame i and the frames above it, which never returned.
+static void profileUnwind(Profile *p, int i, long long instructions) {
+    for (int j = p->depth - 1; j >= i; j--)
+        p->inclusive[p->frames[j].routine] +=
+            instructions - p->frames[j].start;
+    p->node = p->frames[i].parent;
+    p->depth = i;
+}
+
+// A JMP I through location to pc. Close the frame it returns from, if any.
+static int profileReturn(Profile *p, uint16 location, uint16 pc,
+                         long long instructions) {
+    int i = p->depth - 1;
+    while (i >= 0 && p->frames[i].routine != location &&
+           ((pc - p->frames[i].caller) & 07777) >= PROFILE_SKIP)
+        i--;
+    if (i < 0) return 0;
+    profileUnwind(p, i, instructions);
+    return 1;
+}
+
+// A JMS to routine, or an interrupt, which calls location 0, returning to
+// caller.
+static void profileCall(Profile *p, uint16 routine, uint16 caller,
+                        long long instructions) {
+    if (p->nodes == 0) p->nodes = 1;  // the top level
+    p->calls[routine]++;
+    for (int i = p->depth - 1; i >= 0; i--) {
+        if (p->frames[i].routine == routine) {
+            profileUnwind(p, i, instructions);
+            break;
+        }
+    }
+    if (p->depth == PROFILE_DEPTH) {
+        memmove(p->frames, p->frames + 1,
+                (PROFILE_DEPTH - 1) * sizeof(Frame));
+        p->depth--;
+    }
+    Frame *f = &p->frames[p->depth++];
+    f->routine = routine;
+    f->caller = caller;
+    f->parent = p->node;
+    f->start = instructions;
+    p->node = stackNode(p, p->node, routine);
+}
+
+static void profileLoop(Profile *p, uint16 head, uint16 from,
+                        long long iterations) {
+    p->loops[head] += iterations;
+    if (p->loopEnd[head] < from) p->loopEnd[head] = from;
+}
+
+// Count the instruction inst at pc, which ran as the given number of
+// instructions: more than one for an ISZ that ran its whole delay loop.
+static void profileInst(Machine *m, uint16 pc, uint16 inst, long long ran) {
+    Profile *p = m->profile;
+
+    p->count[pc]++;
+    p->self[p->node] += ran;
+    switch (inst >> 9) {
+        case OP_ISZ:
+            if (ran > 1) {  // see countLoop()
+                uint16 jump = (pc + 1) & 07777;
+                p->count[pc] += (ran + 1) / 2 - 1;
+                p->count[jump] += ran / 2;
+                profileLoop(p, pc, jump, ran / 2);
+            }
+            break;
+        case OP_JMS:
+            profileCall(p, (m->PC - 1) & 07777, (pc + 1) & 07777,
+                        m->instructions);
+            break;
+        case OP_JMP:
+            if (inst & 00400) {
+                uint16 location =
+                    (inst & 0177) | (inst & 00200 ? pc & 07600 : 0);
+                if (profileReturn(p, location, m->PC, m->instructions)) break;
+            }
+            if (m->PC <= pc) profileLoop(p, m->PC, pc, 1);
+            break;
+    }
+}
+
+// The IOTs and JMPs of an idle IOT; JMP .-1 loop that run() skipped, the
+// JMP at jmp.
+static void profileIdle(Profile *p, uint16 jmp, long long iots,
+                        long long jumps) {
+    uint16 iot = (jmp - 1) & 07777;
+    p->count[iot] += iots;
+    p->count[jmp] += jumps;
+    p->self[p->node] += iots + jumps;
+    profileLoop(p, iot, jmp, jumps);
+}
+
+// The reference interpreter with every instruction profiled, for -P, and
+// traced as well for -d or -t.
+static void runProfiled(Machine *m) {
+    int traced = isDebug || m->trace;
+    while (!m->attention && m->instructions < m->sliceEnd) {
+        uint16 pc = m->PC;
+        uint16 inst = m->ifMemory[pc];
+        long long before = m->instructions;
+        if (traced)
+            stepTraced(m);
+        else
+            stepSwitch(m);
+        if (m->instructions > before)  // not stopped at the stop address
+            profileInst(m, pc, inst, m->instructions - before);
+    }
+}
+
+// Fill in the predecoded record for the word at address.
+static void decodeInst(Machine *m, uint16 address) {
+    uint16 inst = m->memory[address];
+    DecodedInst *d = &m->decoded[address];
+    uint16 op = (inst >> 9) & 07;
+
+    d->flags = 0;
+    d->cycles = instCycles(inst, address);
+    if (op == OP_IO) {
+        d->handler = H_IOT;
+        d->address = inst;
+    } else if (op == OP_MICRO) {
+        if ((inst & 00400) == 0)
+            d->handler = H_GROUP1;
+        else if ((inst & 00001) == 0)
+            d->handler = H_GROUP2;
+        else
+            d->handler = H_GROUP3;
+        d->address = inst;
+    } else {
+        // page of the instruction itself, as getAddrPageCurrent sees it
+        d->address = (inst & 0177);
+        if ((inst >> 7) & 00001) d->address |= address & 07600;
+        d->handler = H_AND + op;
+        if ((inst >> 8) & 00001) {
+            d->handler += H_AND_I - H_AND;
+            d->flags = DECODE_INDIRECT;
+            if ((d->address & 07770) == 00010) d->flags |= DECODE_AUTOINDEX;
+        }
+        if (isCountLoop(m->memory + (address & 070000), address & 07777))
+            d->flags |= DECODE_LOOP;
+    }
+    if (stopsAt(m, address)) {
+        d->handler = H_STOP;
+        d->cycles = 0;
+    } else {
+        fuseInst(m, address);
+    }
+}
+
+// Turn the record decodeInst() just filled in for the word at address into
+// a superinstruction if the word and the one after it make one. The second
+// word is never one the engines stop at, and the first never stores into
+// it, so running the pair in one handler is the same as running them in
+// turn; a jump to the second word runs its own record.
+static void fuseInst(Machine *m, uint16 address) {
+    DecodedInst *d = &m->decoded[address];
+    uint16 next = (address & 070000) | ((address + 1) & 07777);
+    uint16 inst = m->memory[next];
+    uint16 ea = (inst & 00177) | ((inst & 00200) ? next & 07600 : 0);
+
+    if (stopsAt(m, next)) return;
+    switch (d->handler) {
+        case H_TAD:
+            if ((inst & 07400) != 03000) return;  // DCA y
+            d->handler = H_TAD_DCA;
+            break;
+        case H_TAD_I:
+            if ((inst & 07400) != 03400) return;  // DCA I y
+            if (d->flags & DECODE_AUTOINDEX && d->address == (next & 07777))
+                return;
+            d->handler = H_TAD_DCA_I;
+            if ((ea & 07770) == 00010) d->flags |= DECODE_NEXT_AUTOINDEX;
+            break;
+        case H_ISZ:
+            // ISZ x; JMP .-1 is left to countLoop()
+            if ((inst & 07400) != 05000 || d->flags & DECODE_LOOP) return;
+            if (d->address == (next & 07777)) return;
+            d->handler = H_ISZ_JMP;
+            break;
+        case H_GROUP1:
+            if ((d->address & 07677) != 07200) return;  // CLA, maybe CLL
+            if ((inst & 07400) != 01000) return;        // TAD x
+            d->handler = H_CLA_TAD;
+            break;
+        default:
+            return;
+    }
+    d->next = ea;
+    d->nextCycles = instCycles(inst, next);
+}
+
+// Direct JMP at address at that goes to target.
+static int jumpsTo(uint16 inst, uint16 at, uint16 target) {
+    uint16 to = (inst & 00177) | ((inst & 00200) ? at & 07600 : 0);
+    return (inst & 07400) == 05000 && to == target;
+}
+
+// ISZ at address, without autoindexing, followed by a JMP back to it.
+static int isCountLoop(const uint16 *memory, uint16 address) {
+    uint16 inst = memory[address];
+    uint16 next = (address + 1) & 07777;
+    uint16 pointer = (inst & 00177) | ((inst & 00200) ? address & 07600 : 0);
+
+    if ((inst >> 9) != OP_ISZ) return 0;
+    if ((inst & 00400) && (pointer & 07770) == 00010) return 0;
+    return jumpsTo(memory[next], next, address);
+}
+
+// *pc holds an ISZ in the instruction field with operand ea, a full
+// address, that isCountLoop() accepts: run the loop in one step, or as
+// many whole iterations as budget instructions allow. Returns the
+// instructions run and leaves *pc where the loop got to; 0 means run the
+// ISZ normally.
+static long long countLoop(Machine *m, uint16 *pc, uint16 ea,
+                           long long budget) {
+    uint16 at = m->IF | *pc;
+    uint16 next = m->IF | ((*pc + 1) & 07777);
+
+    if (!isCountLoop(m->ifMemory, *pc) || ea == at || ea == next) return 0;
+    if (stopsAt(m, at) || stopsAt(m, next)) return 0;
+
+    // the caller has counted the cycles of the first ISZ
+    int isz = instCycles(m->ifMemory[*pc], *pc);
+    long long n = 010000 - m->memory[ea];  // ISZs until the counter wraps
+    if (2 * n - 1 <= budget) {
+        writeMemory(m, ea, 0);
+        *pc = (*pc + 2) & 07777;
+        m->cycles += (n - 1) * (isz + 1);
+        return 2 * n - 1;
+    }
+    long long iterations = budget / 2;
+    if (iterations == 0) return 0;
+    writeMemory(m, ea, m->memory[ea] + iterations);
+    m->cycles += (iterations - 1) * isz + iterations;
+    return 2 * iterations;
+}
+
+// Threaded engine: executes from the predecoded instruction cache, keeping
+// AC, LK and PC in locals and jumping from handler to handler. Uses computed
+// goto where the compiler has it and a plain switch otherwise.
+static void runThreaded(Machine *m) {
+    uint16 ac = m->AC;
+    uint16 lk = m->LK;
+    uint16 pc = m->PC;
+    uint16 ea;            // effective address, within its field
+    uint16 *operand;      // the operand word
+    uint16 *ifm = m->ifMemory;  // instruction field
+    uint16 *dfm = m->dfMemory;  // data field; only IOTs change it
+    DecodedInst *ifd = m->decoded + m->IF;  // records of the instruction field
+    long long count = 0;  // instructions not yet added to m->instructions
+    long long cycles = 0;  // and their memory cycles, added at dispatch
+    long long left = m->sliceEnd - m->instructions;  // limit on count
+    DecodedInst *d;
+
+    if (left <= 0) return;
+
+#define STORE(p, value)                 \
+    do {                                \
+        *(p) = (value);                 \
+        dropDecoded(m, (p) - m->memory); \
+    } while (0)
+
+    // operand address of an indirect instruction, from the pointer in the
+    // instruction field
+#define INDIRECT_ADDRESS()                            \
+    do {                                              \
+        ea = d->address;                              \
+        if (d->flags & DECODE_AUTOINDEX)              \
+            STORE(ifm + ea, (ifm[ea] + 1) & 07777);   \
+        ea = ifm[ea] & 07777;                         \
+    } while (0)
+
+    // JMP and JMS take the field a CIF set up; the slice ends after them
+#define NEW_FIELD()                       \
+    do {                                  \
+        if (m->fieldPending) {            \
+            takeField(m);                 \
+            ifm = m->ifMemory;            \
+            ifd = m->decoded + m->IF;     \
+            left = count + 1;             \
+        }                                 \
+    } while (0)
+
+#define SYNC_OUT()                                                        \
+    (m->AC = ac, m->LK = lk, m->PC = pc, m->instructions += count,           \
+     m->cycles += cycles, count = 0, cycles = 0)
+
+#ifdef __GNUC__
+    static void *dispatchTable[H_COUNT] = {
+        &&L_H_DECODE, &&L_H_AND,   &&L_H_TAD,   &&L_H_ISZ,    &&L_H_DCA,
+        &&L_H_JMS,    &&L_H_JMP,   &&L_H_AND_I, &&L_H_TAD_I,  &&L_H_ISZ_I,
+        &&L_H_DCA_I,  &&L_H_JMS_I, &&L_H_JMP_I, &&L_H_IOT,    &&L_H_GROUP1,
+        &&L_H_GROUP2, &&L_H_GROUP3, &&L_H_STOP,   &&L_H_TAD_DCA,
+        &&L_H_TAD_DCA_I, &&L_H_ISZ_JMP, &&L_H_CLA_TAD};
+#define CASE(h) \
+    case h:     \
+    L_##h
+#define DISPATCH()                       \
+    do {                                 \
+        if (++count >= left) goto stop;  \
+        d = &ifd[pc];                    \
+        cycles += d->cycles;             \
+        goto *dispatchTable[d->handler]; \
+    } while (0)
+#else
+#define CASE(h) case h
+#define DISPATCH()                      \
+    do {                                \
+        if (++count >= left) goto stop; \
+        goto dispatch;                  \
+    } while (0)
+#endif
+
+dispatch:
+    d = &ifd[pc];
+    cycles += d->cycles;
+    switch (d->handler) {
+        CASE(H_DECODE):
+            cycles -= d->cycles;  // left over from what the word was
+            decodeInst(m, m->IF | pc);
+            goto dispatch;
+
+        CASE(H_AND):
+            operand = ifm + d->address;
+        and:
+            ac = ac & *operand;
+            pc = (pc + 1) & 07777;
+            DISPATCH();
+        CASE(H_AND_I):
+            INDIRECT_ADDRESS();
+            operand = dfm + ea;
+            goto and;
+
+        CASE(H_TAD):
+            operand = ifm + d->address;
+        tad:
+            ac = (ac | lk) + *operand;
+            lk = ac & 010000;
+            ac = ac & 007777;
+            pc = (pc + 1) & 07777;
+            DISPATCH();
+        CASE(H_TAD_I):
+            INDIRECT_ADDRESS();
+            operand = dfm + ea;
+            goto tad;
+
+        CASE(H_ISZ):
+            operand = ifm + d->address;
+        isz:
+            if (d->flags & DECODE_LOOP) {
+                long long ran =
+                    countLoop(m, &pc, operand - m->memory, left - count);
+                if (ran) {
+                    count += ran - 1;
+                    DISPATCH();
+                }
+            }
+            STORE(operand, (*operand + 1) & 07777);
+            pc = (pc + (*operand == 0 ? 2 : 1)) & 07777;
+            DISPATCH();
+        CASE(H_ISZ_I):
+            INDIRECT_ADDRESS();
+            operand = dfm + ea;
+            goto isz;
+
+        CASE(H_DCA):
+            operand = ifm + d->address;
+        dca:
+            STORE(operand, ac);
+            ac = 0;
+            pc = (pc + 1) & 07777;
+            DISPATCH();
+        CASE(H_DCA_I):
+            INDIRECT_ADDRESS();
+            operand = dfm + ea;
+            goto dca;
+
+        CASE(H_JMS):
+            ea = d->address;
+        jms:
+            NEW_FIELD();
+            STORE(ifm + ea, (pc + 1) & 07777);
+            pc = (ea + 1) & 07777;
+            DISPATCH();
+        CASE(H_JMS_I):
+            INDIRECT_ADDRESS();
+            goto jms;
+
+        CASE(H_JMP):
+            pc = d->address;
+            NEW_FIELD();
+            DISPATCH();
+        CASE(H_JMP_I):
+            INDIRECT_ADDRESS();
+            pc = ea;
+            NEW_FIELD();
+            DISPATCH();
+
+        CASE(H_IOT):
+            // device state may have changed, so let run() service it
+            pc = (pc + 1) & 07777;
+            SYNC_OUT();
+            m->instructions++;
+            executeIOT(m, d->address);
+            return;
+
+        CASE(H_GROUP1):
+            operateGroup1(d->address, &ac, &lk);
+            pc = (pc + 1) & 07777;
+            DISPATCH();
+
+        CASE(H_GROUP2):
+            // A branch rather than a computed PC, so the next dispatch is
+            // predicted instead of waiting on the skip condition.
+            if (operateGroup2(d->address, &ac, lk)) {
+                pc = (pc + 2) & 07777;
+                DISPATCH();
+            }
+            pc = (pc + 1) & 07777;
+            DISPATCH();
+
+        CASE(H_GROUP3):
+            // EAE state and operands are in m
+            m->AC = ac;
+            m->LK = lk;
+            m->PC = (pc + 1) & 07777;
+            operateGroup3(m, d->address);
+            ac = m->AC;
+            lk = m->LK;
+            pc = m->PC;
+            DISPATCH();
+
+        CASE(H_STOP):
+            // the monitor may let the word run, and the slice go on
+            SYNC_OUT();
+            if (!monitorPass(m)) {
+                m->stopped = 1;
+                m->attention = 1;
+                return;
+            }
+            if (m->attention || m->instructions >= m->sliceEnd) return;
+            ac = m->AC;
+            lk = m->LK;
+            pc = m->PC;
+            left = m->sliceEnd - m->instructions;
+            goto dispatch;
+
+        // Superinstructions run both words, or only the first when the
+        // slice has room for just one instruction.
+        CASE(H_TAD_DCA):
+            operand = ifm + d->address;
+            if (count + 1 >= left) goto tad;
+            m->fused[H_TAD_DCA - H_FUSED]++;
+            cycles += d->nextCycles;
+            ac = (ac | lk) + *operand;
+            lk = ac & 010000;
+            STORE(ifm + d->next, ac & 07777);
+            ac = 0;
+            pc = (pc + 2) & 07777;
+            count++;
+            DISPATCH();
+
+        CASE(H_TAD_DCA_I):
+            INDIRECT_ADDRESS();
+            operand = dfm + ea;
+            if (count + 1 >= left) goto tad;
+            m->fused[H_TAD_DCA_I - H_FUSED]++;
+            cycles += d->nextCycles;
+            ac = (ac | lk) + *operand;
+            lk = ac & 010000;
+            ea = d->next;
+            if (d->flags & DECODE_NEXT_AUTOINDEX)
+                STORE(ifm + ea, (ifm[ea] + 1) & 07777);
+            ea = ifm[ea] & 07777;
+            STORE(dfm + ea, ac & 07777);
+            ac = 0;
+            pc = (pc + 2) & 07777;
+            count++;
+            DISPATCH();
+
+        CASE(H_ISZ_JMP):
+            operand = ifm + d->address;
+            if (count + 1 >= left) goto isz;
+            m->fused[H_ISZ_JMP - H_FUSED]++;
+            STORE(operand, (*operand + 1) & 07777);
+            if (*operand == 0) {
+                pc = (pc + 2) & 07777;  // skipped the JMP
+            } else {
+                pc = d->next;
+                count++;
+                cycles += d->nextCycles;
+                NEW_FIELD();
+            }
+            DISPATCH();
+
+        CASE(H_CLA_TAD):
+            if (count + 1 >= left) {
+                operateGroup1(d->address, &ac, &lk);
+                pc = (pc + 1) & 07777;
+                DISPATCH();
+            }
+            m->fused[H_CLA_TAD - H_FUSED]++;
+            cycles += d->nextCycles;
+            ac = ifm[d->next];
+            if (d->address & 00100) lk = 0;  // CLL
+            pc = (pc + 2) & 07777;
+            count++;
+            DISPATCH();
+    }
+    goto dispatch;
+
+stop:
+    SYNC_OUT();
+
+#undef STORE
+#undef INDIRECT_ADDRESS
+#undef NEW_FIELD
+#undef SYNC_OUT
+#undef CASE
+#undef DISPATCH
+}
+
+// The translators leave IOTs and group 3 instructions to stepSwitch().
+static int translatable(uint16 inst) {
+    if ((inst >> 9) == OP_IO) return 0;
+    if ((inst >> 9) == OP_MICRO && (inst & 00401) == 00401) return 0;
+    return 1;
+}
+
+// Ends a translated block after itself: control transfers and skips.
+static int endsBlock(uint16 inst) {
+    switch (inst >> 9) {
+        case OP_ISZ:
+        case OP_JMS:
+        case OP_JMP:
+            return 1;
+        case OP_MICRO:
+            return (inst & 00400) && (inst & 00170);
+    }
+    return 0;
+}
+
+#ifdef JIT_SUPPORTED
+// Basic-block translator to x86-64. A block is a straight run of
+// instructions in one page, ending at JMP, JMS, ISZ, a skipping group 2
+// operate, or just before an IOT/group 3 instruction, which are left to
+// stepSwitch(). In translated code AC lives in r12d, LK in r13d, the
+// memory base in r14, the JitContext in r15 and the remaining instruction
+// budget in rbx. Blocks chain to each other through jit.entry[], so
+// dropping a page only needs its entries pointed back at the translate
+// stub. Stores check jit.code[] first and, if they would hit translated
+// code, leave the block before changing any state so that stepSwitch()
+// can perform the store and the page can be dropped.
+
+// Register numbers used by the encoder
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+static void emit8(Jit *j, int b) { j->buffer[j->used++] = b; }
+
+static void emit16(Jit *j, int v) {
+    emit8(j, v & 0xff);
+    emit8(j, (v >> 8) & 0xff);
+}
+
+static void emit32(Jit *j, int v) {
+    emit16(j, v & 0xffff);
+    emit16(j, (v >> 16) & 0xffff);
+}
+
+static void patch32(Jit *j, int at, int v) {
+    int saved = j->used;
+    j->used = at;
+    emit32(j, v);
+    j->used = saved;
+}
+
+static void emitRex(Jit *j, int w, int reg, int index, int base) {
+    int rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) |
+              (base >> 3);
+    if (rex != 0x40) emit8(j, rex);
+}
+
+// op r/m32, r32 with both operands registers (add, or, and, xor, mov, ...)
+static void emitRR(Jit *j, int op, int dst, int src) {
+    emitRex(j, 0, src, 0, dst);
+    emit8(j, op);
+    emit8(j, 0xc0 | ((src & 7) << 3) | (dst & 7));
+}
+
+// 81 /digit r32, imm32 (digit: 0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp)
+static void emitRI(Jit *j, int digit, int dst, int imm) {
+    emitRex(j, 0, 0, 0, dst);
+    emit8(j, 0x81);
+    emit8(j, 0xc0 | (digit << 3) | (dst & 7));
+    emit32(j, imm);
+}
+
+// C1 /digit r32, imm8 (digit: 4 shl, 5 shr)
+static void emitShift(Jit *j, int digit, int dst, int count) {
+    emitRex(j, 0, 0, 0, dst);
+    emit8(j, 0xc1);
+    emit8(j, 0xc0 | (digit << 3) | (dst & 7));
+    emit8(j, count);
+}
+
+// ModRM (and SIB) for a memory word: memory[ea] when indexed is 0,
+// memory[ecx] otherwise. The base is always r14.
+static void emitWordOperand(Jit *j, int reg, int indexed, uint16 ea) {
+    if (indexed) {
+        emit8(j, 0x04 | ((reg & 7) << 3));
+        emit8(j, 0x40 | (RCX << 3) | (R14 & 7));  // [r14 + rcx*2]
+    } else {
+        emit8(j, 0x80 | ((reg & 7) << 3) | (R14 & 7));
+        emit32(j, ea * 2);
+    }
+}
+
+// movzx reg, word memory[...]
+static void emitLoadWord(Jit *j, int reg, int indexed, uint16 ea) {
+    emitRex(j, 0, reg, 0, R14);
+    emit8(j, 0x0f);
+    emit8(j, 0xb7);
+    emitWordOperand(j, reg, indexed, ea);
+}
+
+// mov word memory[...], reg
+static void emitStoreWord(Jit *j, int reg, int indexed, uint16 ea) {
+    emit8(j, 0x66);
+    emitRex(j, 0, reg, 0, R14);
+    emit8(j, 0x89);
+    emitWordOperand(j, reg, indexed, ea);
+}
+
+// Field of the JitContext at [r15 + offset]: op reg, field
+static void emitContext(Jit *j, int w, int prefix16, int opcode2, int op,
+                        int reg, int offset) {
+    if (prefix16) emit8(j, 0x66);
+    emitRex(j, w, reg, 0, R15);
+    if (opcode2) emit8(j, 0x0f);
+    emit8(j, op);
+    emit8(j, 0x80 | ((reg & 7) << 3) | (R15 & 7));
+    emit32(j, offset);
+}
+
+// jcc rel32 to a stub emitted after the block
+static void emitJccStub(Jit *j, int cc, int kind, int index, uint16 pc,
+                        uint16 smcAddress) {
+    JitStub *s = &j->stubs[j->stubCount++];
+    emit8(j, 0x0f);
+    emit8(j, 0x80 | cc);
+    s->kind = kind;
+    s->patch = j->used;
+    s->index = index;
+    s->pc = pc;
+    s->smcAddress = smcAddress;
+    emit32(j, 0);
+}
+
+// Leave the block if memory[ea] (or memory[ecx]) is translated code.
+static void emitCodeCheck(Jit *j, int indexed, uint16 ea, int index,
+                          uint16 pc) {
+    // cmp byte [r15 + code + (ea or rcx)], 0
+    emitRex(j, 0, 0, indexed ? RCX : 0, R15);
+    emit8(j, 0x80);
+    if (indexed) {
+        emit8(j, 0x84 | (7 << 3));
+        emit8(j, (RCX << 3) | (R15 & 7));
+        emit32(j, offsetof(JitContext, code));
+    } else {
+        emit8(j, 0x80 | (7 << 3) | (R15 & 7));
+        emit32(j, offsetof(JitContext, code) + ea);
+    }
+    emit8(j, 0);
+    emitJccStub(j, 0x5, indexed ? STUB_SMC_ECX : STUB_SMC_CONST, index, pc, ea);
+}
+
+// Continue at a known address: esi = pc; jmp [r15 + pc*8]
+static void emitChain(Jit *j, uint16 pc) {
+    emit8(j, 0xbe);
+    emit32(j, pc);
+    emit8(j, 0x41);
+    emit8(j, 0xff);
+    emit8(j, 0xa7);
+    emit32(j, offsetof(JitContext, entry) + pc * 8);
+}
+
+// Continue at the address in esi: jmp [r15 + rsi*8]
+static void emitChainESI(Jit *j) {
+    emit8(j, 0x41);
+    emit8(j, 0xff);
+    emit8(j, 0x24);
+    emit8(j, 0xc0 | (RSI << 3) | (R15 & 7));
+}
+
+// esi = pc; edi = reason; jmp exit
+static void emitExit(Jit *j, uint16 pc, int reason) {
+    emit8(j, 0xbe);
+    emit32(j, pc);
+    emit8(j, 0xbf);
+    emit32(j, reason);
+    emit8(j, 0xe9);
+    emit32(j, j->exitOffset - (j->used + 4));
+}
+
+// ac = (lk | ac) + eax, carrying into lk
+static void emitAddToAC(Jit *j) {
+    emitRR(j, 0x09, R12, R13);
+    emitRR(j, 0x01, R12, RAX);
+    emitRR(j, 0x89, R13, R12);
+    emitRI(j, 4, R13, 010000);
+    emitRI(j, 4, R12, 007777);
+}
+
+// lk = ac & 010000; ac = ac & 07777
+static void emitSplitLink(Jit *j) {
+    emitRR(j, 0x89, R13, R12);
+    emitRI(j, 4, R13, 010000);
+    emitRI(j, 4, R12, 007777);
+}
+
+static void emitGroup1(Jit *j, uint16 inst) {
+    if (inst & 00200) emitRR(j, 0x31, R12, R12);      // CLA
+    if (inst & 00100) emitRR(j, 0x31, R13, R13);      // CLL
+    if (inst & 00040) emitRI(j, 6, R12, 007777);      // CMA
+    if (inst & 00020) emitRI(j, 6, R13, 010000);      // CML
+    if (inst & 00001) {                            // IAC
+        emitRR(j, 0x09, R12, R13);
+        emitRI(j, 0, R12, 1);
+        emitSplitLink(j);
+    }
+    switch ((inst >> 1) & 00007) {
+        case 01:  // BSW
+            emitRR(j, 0x89, RAX, R12);
+            emitShift(j, 4, RAX, 6);
+            emitShift(j, 5, R12, 6);
+            emitRR(j, 0x09, R12, RAX);
+            emitRI(j, 4, R12, 007777);
+            break;
+        case 02:  // RAL
+            emitRR(j, 0x89, RAX, R13);
+            emitShift(j, 5, RAX, 12);
+            emitShift(j, 4, R12, 1);
+            emitRR(j, 0x09, R12, RAX);
+            emitSplitLink(j);
+            break;
+        case 03:  // RTL
+            emitRR(j, 0x89, RAX, R12);
+            emitRR(j, 0x09, RAX, R13);
+            emitShift(j, 5, RAX, 11);
+            emitShift(j, 4, R12, 2);
+            emitRR(j, 0x09, R12, RAX);
+            emitSplitLink(j);
+            break;
+        case 04:  // RAR
+        case 05:  // RTR
+            emitRR(j, 0x89, RAX, R12);
+            emitRR(j, 0x09, RAX, R13);
+            emitShift(j, 5, RAX, (inst & 00002) ? 2 : 1);
+            emitShift(j, 4, R12, (inst & 00002) ? 11 : 12);
+            emitRR(j, 0x09, R12, RAX);
+            emitSplitLink(j);
+            break;
+        case 06:  // RAR RAL
+            emitRI(j, 4, R12, inst);
+            break;
+    }
+}
+
+// al = skip condition of a group 2 instruction, then CLA
+static void emitGroup2(Jit *j, uint16 inst) {
+    int andGroup = inst & 00010;
+
+    if (andGroup) {
+        emit8(j, 0xb0);  // mov al, 1
+        emit8(j, 1);
+    } else {
+        emitRR(j, 0x31, RAX, RAX);
+    }
+    if (inst & 00100) {  // SMA / SPA
+        emitRex(j, 0, 0, 0, R12);
+        emit8(j, 0xf7);
+        emit8(j, 0xc0 | (R12 & 7));
+        emit32(j, 04000);
+        emit8(j, 0x0f);
+        emit8(j, andGroup ? 0x94 : 0x95);  // setz / setnz dl
+        emit8(j, 0xc2);
+        emit8(j, andGroup ? 0x20 : 0x08);  // and / or al, dl
+        emit8(j, 0xd0);
+    }
+    if (inst & 00040) {  // SZA / SNA
+        emitRR(j, 0x85, R12, R12);
+        emit8(j, 0x0f);
+        emit8(j, andGroup ? 0x95 : 0x94);
+        emit8(j, 0xc2);
+        emit8(j, andGroup ? 0x20 : 0x08);
+        emit8(j, 0xd0);
+    }
+    if (inst & 00020) {  // SNL / SZL
+        emitRR(j, 0x85, R13, R13);
+        emit8(j, 0x0f);
+        emit8(j, andGroup ? 0x94 : 0x95);
+        emit8(j, 0xc2);
+        emit8(j, andGroup ? 0x20 : 0x08);
+        emit8(j, 0xd0);
+    }
+    if (inst & 00200) emitRR(j, 0x31, R12, R12);  // CLA
+}
+
+// if (condition) continue at skipPC else at nextPC
+static void emitSkip(Jit *j, int cc, uint16 nextPC, uint16 skipPC) {
+    emit8(j, 0x70 | (cc ^ 1));  // short jcc over the taken chain
+    emit8(j, 12);
+    emitChain(j, skipPC);
+    emitChain(j, nextPC);
+}
+
+static void jitReset(Jit *j) {
+    for (int i = 0; i < 4096; i++)
+        j->context.entry[i] = j->buffer + j->translateOffset;
+    memset(j->context.code, 0, sizeof(j->context.code));
+    j->used = j->fixed;
+}
+
+static void jitInvalidatePage(Jit *j, uint16 address) {
+    uint16 first = address & 07600;
+    for (int i = first; i < first + 0200; i++) {
+        j->context.entry[i] = j->buffer + j->translateOffset;
+        j->context.code[i] = 0;
+    }
+}
+
+static int jitInit(Jit *j, uint16 *memory) {
+    j->buffer = mmap(NULL, JIT_BUFSIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->buffer == MAP_FAILED) {
+        j->buffer = NULL;
+        return 0;
+    }
+    j->used = 0;
+
+    // void jitEnter(JitContext *rdi)
+    emit8(j, 0x53);  // push rbx
+    emit8(j, 0x55);  // push rbp
+    emit8(j, 0x41);  // push r12..r15
+    emit8(j, 0x54);
+    emit8(j, 0x41);
+    emit8(j, 0x55);
+    emit8(j, 0x41);
+    emit8(j, 0x56);
+    emit8(j, 0x41);
+    emit8(j, 0x57);
+    emit8(j, 0x48);  // sub rsp, 8
+    emit8(j, 0x83);
+    emit8(j, 0xec);
+    emit8(j, 0x08);
+    emitRex(j, 1, RDI, 0, R15);  // mov r15, rdi
+    emit8(j, 0x89);
+    emit8(j, 0xc0 | (RDI << 3) | (R15 & 7));
+    emitContext(j, 1, 0, 0, 0x8b, R14, offsetof(JitContext, memory));
+    emitContext(j, 0, 0, 1, 0xb7, R12, offsetof(JitContext, ac));
+    emitContext(j, 0, 0, 1, 0xb7, R13, offsetof(JitContext, lk));
+    emitContext(j, 1, 0, 0, 0x8b, RBX, offsetof(JitContext, budget));
+    emitContext(j, 0, 0, 1, 0xb7, RSI, offsetof(JitContext, pc));
+    emitChainESI(j);
+
+    // exit: esi = pc, edi = reason
+    j->exitOffset = j->used;
+    emitContext(j, 0, 1, 0, 0x89, R12, offsetof(JitContext, ac));
+    emitContext(j, 0, 1, 0, 0x89, R13, offsetof(JitContext, lk));
+    emitContext(j, 0, 1, 0, 0x89, RSI, offsetof(JitContext, pc));
+    emitContext(j, 0, 0, 0, 0x89, RDI, offsetof(JitContext, reason));
+    emitContext(j, 1, 0, 0, 0x89, RBX, offsetof(JitContext, budget));
+    emit8(j, 0x48);  // add rsp, 8
+    emit8(j, 0x83);
+    emit8(j, 0xc4);
+    emit8(j, 0x08);
+    emit8(j, 0x41);  // pop r15..r12
+    emit8(j, 0x5f);
+    emit8(j, 0x41);
+    emit8(j, 0x5e);
+    emit8(j, 0x41);
+    emit8(j, 0x5d);
+    emit8(j, 0x41);
+    emit8(j, 0x5c);
+    emit8(j, 0x5d);  // pop rbp
+    emit8(j, 0x5b);  // pop rbx
+    emit8(j, 0xc3);  // ret
+
+    // untranslated address in esi
+    j->translateOffset = j->used;
+    emit8(j, 0xbf);
+    emit32(j, JIT_EXIT_TRANSLATE);
+    emit8(j, 0xe9);
+    emit32(j, j->exitOffset - (j->used + 4));
+
+    j->fixed = j->used;
+    j->enter = (void (*)(JitContext *))j->buffer;
+    j->context.memory = memory;
+    jitReset(j);
+    if (mprotect(j->buffer, JIT_BUFSIZE, PROT_READ | PROT_EXEC) != 0)
+        return 0;
+    return 1;
+}
+
+// Translate the block starting at pc. Returns 0 if the first instruction
+// has to be interpreted.
+static int jitTranslate(Machine *m, uint16 pc) {
+    Jit *j = &m->jit;
+    int count = 0;
+    uint16 at = pc;
+
+    // find the end of the block
+    while (count < JIT_BLOCK_MAX) {
+        uint16 inst = m->memory[at];
+        if (!translatable(inst)) break;
+        if (isCountLoop(m->memory, at)) break;  // stepSwitch() runs these
+        if (stopsAt(m, at)) break;
+        count++;
+        if (endsBlock(inst)) break;
+        at = (at + 1) & 07777;
+        if ((at & 0177) == 0) break;  // page boundary
+    }
+    if (count == 0) return 0;
+
+    if (j->used + JIT_BLOCK_ROOM > JIT_BUFSIZE) jitReset(j);
+    if (mprotect(j->buffer, JIT_BUFSIZE, PROT_READ | PROT_WRITE) != 0)
+        return 0;
+
+    // cycles from each instruction to the end of the block, which a stub
+    // takes back if it leaves there
+    int rest[JIT_BLOCK_MAX + 1];
+    rest[count] = 0;
+    for (int k = count - 1; k >= 0; k--)
+        rest[k] = rest[k + 1] + instCycles(m->memory[(pc + k) & 07777],
+                                           (pc + k) & 07777);
+
+    unsigned char *entry = j->buffer + j->used;
+    j->stubCount = 0;
+
+    // add qword [r15 + cycles], cycles of the block
+    emitContext(j, 1, 0, 0, 0x81, 0, offsetof(JitContext, cycles));
+    emit32(j, rest[0]);
+
+    // sub rbx, count; js budget stub
+    emit8(j, 0x48);
+    emit8(j, 0x81);
+    emit8(j, 0xeb);
+    emit32(j, count);
+    emitJccStub(j, 0x8, STUB_BUDGET, 0, pc, 0);
+
+    int ended = 0;
+    at = pc;
+    for (int k = 0; k < count; k++, at = (at + 1) & 07777) {
+        uint16 inst = m->memory[at];
+        uint16 next = (at + 1) & 07777;
+        int op = inst >> 9;
+
+        if (op == OP_MICRO) {
+            if ((inst & 00400) == 0) {
+                emitGroup1(j, inst);
+            } else {
+                emitGroup2(j, inst);
+                if (inst & 00170) {
+                    emit8(j, 0x84);  // test al, al
+                    emit8(j, 0xc0);
+                    emitSkip(j, 0x5, next, (at + 2) & 07777);
+                    ended = 1;
+                }
+            }
+            continue;
+        }
+
+        // effective address, in ea or (indexed) in ecx
+        int writes = op == OP_ISZ || op == OP_DCA || op == OP_JMS;
+        int indexed = (inst >> 8) & 00001;
+        uint16 ea = inst & 0177;
+        if ((inst >> 7) & 00001) ea |= at & 07600;
+        if (indexed) {
+            uint16 pointer = ea;
+            if ((pointer & 07770) == 00010) {  // autoindex
+                emitCodeCheck(j, 0, pointer, k, at);
+                emitLoadWord(j, RCX, 0, pointer);
+                emitRI(j, 0, RCX, 1);
+                emitRI(j, 4, RCX, 007777);
+                if (writes) emitCodeCheck(j, 1, 0, k, at);
+                emitStoreWord(j, RCX, 0, pointer);
+            } else {
+                emitLoadWord(j, RCX, 0, pointer);
+                emitRI(j, 4, RCX, 007777);
+                if (writes) emitCodeCheck(j, 1, 0, k, at);
+            }
+        } else if (writes) {
+            emitCodeCheck(j, 0, ea, k, at);
+        }
+
+        switch (op) {
+            case OP_AND:
+                emitLoadWord(j, RAX, indexed, ea);
+                emitRR(j, 0x21, R12, RAX);
+                break;
+            case OP_TAD:
+                emitLoadWord(j, RAX, indexed, ea);
+                emitAddToAC(j);
+                break;
+            case OP_ISZ:
+                emitLoadWord(j, RAX, indexed, ea);
+                emitRI(j, 0, RAX, 1);
+                emitRI(j, 4, RAX, 007777);
+                emitStoreWord(j, RAX, indexed, ea);
+                emitSkip(j, 0x4, next, (at + 2) & 07777);
+                ended = 1;
+                break;
+            case OP_DCA:
+                emitStoreWord(j, R12, indexed, ea);
+                emitRR(j, 0x31, R12, R12);
+                break;
+            case OP_JMS:
+                // mov word memory[...], return address
+                emit8(j, 0x66);
+                emitRex(j, 0, 0, 0, R14);
+                emit8(j, 0xc7);
+                emitWordOperand(j, 0, indexed, ea);
+                emit16(j, next);
+                if (indexed) {
+                    emit8(j, 0x8d);  // lea esi, [rcx + 1]
+                    emit8(j, 0x71);
+                    emit8(j, 0x01);
+                    emitRI(j, 4, RSI, 007777);
+                    emitChainESI(j);
+                } else {
+                    emitChain(j, (ea + 1) & 07777);
+                }
+                ended = 1;
+                break;
+            case OP_JMP:
+                if (indexed) {
+                    emitRR(j, 0x89, RSI, RCX);
+                    emitChainESI(j);
+                } else {
+                    emitChain(j, ea);
+                }
+                ended = 1;
+                break;
+        }
+    }
+    if (!ended) emitChain(j, at);
+
+    for (int i = 0; i < j->stubCount; i++) {
+        JitStub *s = &j->stubs[i];
+        patch32(j, s->patch, j->used - (s->patch + 4));
+        // add rbx, instructions not executed
+        emit8(j, 0x48);
+        emit8(j, 0x81);
+        emit8(j, 0xc3);
+        emit32(j, count - s->index);
+        // sub qword [r15 + cycles], their cycles
+        emitContext(j, 1, 0, 0, 0x81, 5, offsetof(JitContext, cycles));
+        emit32(j, rest[s->index]);
+        if (s->kind == STUB_BUDGET) {
+            emitExit(j, s->pc, JIT_EXIT_BUDGET);
+        } else {
+            if (s->kind == STUB_SMC_CONST) {
+                emit8(j, 0xb9);  // mov ecx, address
+                emit32(j, s->smcAddress);
+            }
+            emitContext(j, 0, 0, 0, 0x89, RCX,
+                        offsetof(JitContext, smcAddress));
+            emitExit(j, s->pc, JIT_EXIT_SMC);
+        }
+    }
+
+    if (mprotect(j->buffer, JIT_BUFSIZE, PROT_READ | PROT_EXEC) != 0)
+        return 0;
+
+    at = pc;
+    for (int k = 0; k < count; k++, at = (at + 1) & 07777)
+        j->context.code[at] = 1;
+    j->context.entry[pc] = entry;
+    return 1;
+}
+
+// Run translated code, interpreting the instructions it leaves to
+// stepSwitch().
+static void runJit(Machine *m) {
+    Jit *j = &m->jit;
+    JitContext *c = &j->context;
+
+    while (!m->attention && m->instructions < m->sliceEnd) {
+        if (m->IF | m->DF | m->fieldPending) {
+            // translations are of field 0 and use it for every operand
+            stepNoting(m);
+            continue;
+        }
+        long long budget = m->sliceEnd - m->instructions;
+        c->budget = budget;
+        c->ac = m->AC;
+        c->lk = m->LK;
+        c->pc = m->PC;
+        j->enter(c);
+        m->AC = c->ac;
+        m->LK = c->lk;
+        m->PC = c->pc;
+        m->instructions += budget - c->budget;
+        m->cycles += c->cycles;
+        c->cycles = 0;
+        if (c->budget == 0) break;  // slice used up
+
+        switch (c->reason) {
+            case JIT_EXIT_TRANSLATE:
+                if (jitTranslate(m, m->PC)) break;
+                stepNoting(m);
+                break;
+            case JIT_EXIT_SMC:
+                // the store is redone by the interpreter, which notes it
+                // (and any autoindex pointer) against the right pages
+                stepNoting(m);
+                break;
+            case JIT_EXIT_BUDGET:
+                // the next block is longer than the budget left
+                stepNoting(m);
+                break;
+        }
+    }
+}
+#endif
+
+// Ahead-of-time translator (-G): writes field 0 of an image out as C to be
+// linked into the emulator, for runAot(). Routines are recovered by
+// following control flow from 0200 and the start address. A routine is
+// every word reachable from its entry by falling through, skipping or
+// jumping directly that no earlier routine has taken; the word after a
+// JMS target starts another, and so does the word an indirect JMP or JMS
+// points through as the image has it. IOTs and group 3 instructions are
+// left to stepSwitch(), and so is any word the analysis did not reach.
+//
+// Each routine becomes a function that keeps AC, LK, PC and the budget in
+// locals and can be entered at any of its words. Entering charges the
+// instructions and cycles up to the next control transfer at once, and
+// gives them back if it leaves early. Stores that would change translated
+// code leave first so that stepSwitch() performs them, and aotWrote()
+// then turns off the routine that has the word.
+
+// Successors of the instruction at a, for the routine walk: falls through
+// to the next word, skips, or goes to a known address.
+static int aotSuccessors(const uint16 *memory, uint16 a, uint16 *next) {
+    uint16 inst = memory[a];
+    uint16 ea = (inst & 0177) | ((inst & 00200) ? a & 07600 : 0);
+    int n = 0;
+
+    switch (inst >> 9) {
+        case OP_ISZ:
+            next[n++] = (a + 2) & 07777;
+            break;
+        case OP_JMS:
+            break;  // returns through JMP I, to a word added below
+        case OP_JMP:
+            if (!(inst & 00400)) next[n++] = ea;
+            return n;
+        case OP_IO:
+            next[n++] = (a + 2) & 07777;
+            break;
+        case OP_MICRO:
+            if (endsBlock(inst)) next[n++] = (a + 2) & 07777;
+            break;
+    }
+    next[n++] = (a + 1) & 07777;
+    return n;
+}
+
+// Another routine starts at the word the instruction at a leads to, if it
+// is a JMS or goes through a pointer.
+static int aotEntry(const uint16 *memory, uint16 a, uint16 *entry) {
+    uint16 inst = memory[a];
+    uint16 ea = (inst & 0177) | ((inst & 00200) ? a & 07600 : 0);
+    int op = inst >> 9;
+
+    if (op != OP_JMS && op != OP_JMP) return 0;
+    if (inst & 00400) {
+        if ((ea & 07770) == 00010) return 0;  // autoindexed, unknown
+        ea = memory[ea] & 07777;
+    }
+    *entry = op == OP_JMS ? (ea + 1) & 07777 : ea;
+    return op == OP_JMS || (inst & 00400);
+}
+
+// Where the routine goes next: to a word of its own through its entry
+// stub, or back to runAot().
+static void aotGo(FILE *f, const uint16 *owner, int r, uint16 to,
+                  const char *indent) {
+    if (owner[to] == r + 1)
+        fprintf(f, "%sgoto E%04o;\n", indent, to);
+    else
+        fprintf(f, "%spc = 0%o;\n%sgoto leave;\n", indent, to, indent);
+}
+
+// Group 1 operate, the steps operateGroup1() takes for this word.
+static void aotGroup1(FILE *f, uint16 inst) {
+    if (inst & 00200) fprintf(f, "    ac = 0;\n");
+    if (inst & 00100) fprintf(f, "    lk = 0;\n");
+    if (inst & 00040) fprintf(f, "    ac ^= 07777;\n");
+    if (inst & 00020) fprintf(f, "    lk ^= 010000;\n");
+    if (inst & 00001)
+        fprintf(f, "    ac = (ac | lk) + 1;\n"
+                   "    lk = ac & 010000;\n"
+                   "    ac &= 07777;\n");
+    switch ((inst >> 1) & 00007) {
+        case 01:  // BSW
+            fprintf(f, "    ac = (ac & 077) << 6 | ac >> 6;\n");
+            return;
+        case 02:  // RAL
+            fprintf(f, "    ac = ac << 1 | lk >> 12;\n");
+            break;
+        case 03:  // RTL
+            fprintf(f, "    ac = ac << 2 | (lk | ac) >> 11;\n");
+            break;
+        case 04:  // RAR
+            fprintf(f, "    ac = (ac | lk) >> 1 | ac << 12;\n");
+            break;
+        case 05:  // RTR
+            fprintf(f, "    ac = (ac | lk) >> 2 | ac << 11;\n");
+            break;
+        case 06:  // RAR RAL
+            fprintf(f, "    ac &= 0%o;\n", inst);
+            return;
+        default:
+            return;
+    }
+    fprintf(f, "    lk = ac & 010000;\n    ac &= 07777;\n");
+}
+
+// Group 2 skip condition, as operateGroup2() tests it.
+static void aotGroup2(FILE *f, uint16 inst) {
+    const char *tests[3] = {"lk", "ac == 0", "(ac & 04000)"};
+    const char *inverse[3] = {"lk == 0", "ac", "!(ac & 04000)"};
+    int and = inst & 00010;
+    int any = 0;
+
+    fprintf(f, "    t = ");
+    for (int i = 0; i < 3; i++) {
+        if (!(inst & (00020 << i))) continue;
+        fprintf(f, "%s%s", any ? (and ? " && " : " || ") : "",
+                and ? inverse[i] : tests[i]);
+        any = 1;
+    }
+    fprintf(f, "%s;\n", any ? "" : (and ? "1" : "0"));
+}
+
+// Give back what entering charged for the rest of the block, from a, and
+// leave for stepSwitch() to run the instruction at a.
+static void aotInterpret(FILE *f, uint16 a, int count, int cycles,
+                         const char *indent) {
+    fprintf(f,
+            "%spc = 0%o;\n%sbudget += %d;\n%scycles -= %d;\n"
+            "%sgoto interpret;\n",
+            indent, a, indent, count, indent, cycles, indent);
+}
+
+static void aotRoutine(FILE *f, const uint16 *memory, const uint16 *owner,
+                       int r, const int *count, const int *cycles) {
+    uint16 entry = 0;
+    while (owner[entry] != r + 1) entry++;
+
+    fprintf(f,
+            "static void r%04o(AotContext *c) {\n"
+            "    uint16 *M = c->memory;\n"
+            "    unsigned ac = c->ac, lk = c->lk, pc = c->pc, t;\n"
+            "    long long budget = c->budget, cycles = c->cycles;\n\n"
+            "enter:\n"
+            "    switch (pc) {\n",
+            entry);
+    for (int a = 0; a < 4096; a++) {
+        if (owner[a] != r + 1) continue;
+        fprintf(f,
+                "        case 0%o:\n"
+                "        E%04o:\n"
+                "            pc = 0%o;\n"
+                "            if (budget < %d) goto interpret;\n"
+                "            budget -= %d;\n"
+                "            cycles += %d;\n"
+                "            goto I%04o;\n",
+                a, a, a, count[a], count[a], cycles[a], a);
+    }
+    fprintf(f, "    }\n    goto leave;\n");
+
+    for (int a = 0; a < 4096; a++) {
+        if (owner[a] != r + 1) continue;
+        uint16 inst = memory[a];
+        uint16 next = (a + 1) & 07777;
+        uint16 skip = (a + 2) & 07777;
+        uint16 ea = (inst & 0177) | ((inst & 00200) ? a & 07600 : 0);
+        int op = inst >> 9;
+        int writes = op == OP_ISZ || op == OP_DCA || op == OP_JMS;
+        const char *operand = "M[t]";
+        char direct[16];
+
+        fprintf(f, "\nI%04o:  // %04o\n", a, inst);
+        if (op != OP_MICRO) {
+            if (inst & 00400) {
+                if ((ea & 07770) == 00010 && owner[ea]) {
+                    aotInterpret(f, a, count[a], cycles[a], "    ");
+                    continue;
+                }
+                // the check comes before the autoindex store, which
+                // stepSwitch() would repeat
+                if ((ea & 07770) == 00010)
+                    fprintf(f, "    t = (M[0%o] + 1) & 07777;\n", ea);
+                else
+                    fprintf(f, "    t = M[0%o] & 07777;\n", ea);
+                if (writes) {
+                    fprintf(f, "    if (owner[t]) {\n");
+                    aotInterpret(f, a, count[a], cycles[a], "        ");
+                    fprintf(f, "    }\n");
+                }
+                if ((ea & 07770) == 00010)
+                    fprintf(f, "    M[0%o] = t;\n", ea);
+            } else {
+                if (writes && owner[ea]) {
+                    aotInterpret(f, a, count[a], cycles[a], "    ");
+                    continue;
+                }
+                snprintf(direct, sizeof(direct), "M[0%o]", ea);
+                operand = direct;
+            }
+        }
+
+        switch (op) {
+            case OP_AND:
+                fprintf(f, "    ac &= %s;\n", operand);
+                break;
+            case OP_TAD:
+                fprintf(f,
+                        "    ac = (ac | lk) + %s;\n"
+                        "    lk = ac & 010000;\n"
+                        "    ac &= 07777;\n",
+                        operand);
+                break;
+            case OP_ISZ:
+                fprintf(f,
+                        "    %s = (%s + 1) & 07777;\n"
+                        "    if (%s == 0) {\n",
+                        operand, operand, operand);
+                aotGo(f, owner, r, skip, "        ");
+                fprintf(f, "    }\n");
+                aotGo(f, owner, r, next, "    ");
+                continue;
+            case OP_DCA:
+                fprintf(f, "    %s = ac;\n    ac = 0;\n", operand);
+                break;
+            case OP_JMS:
+                fprintf(f, "    %s = 0%o;\n", operand, next);
+                if (inst & 00400) {
+                    fprintf(f, "    pc = (t + 1) & 07777;\n"
+                               "    goto leave;\n");
+                } else {
+                    aotGo(f, owner, r, (ea + 1) & 07777, "    ");
+                }
+                continue;
+            case OP_JMP:
+                if (inst & 00400) {
+                    fprintf(f,
+                            "    pc = t;\n"
+                            "    if (owner[pc] == %d) goto enter;\n"
+                            "    goto leave;\n",
+                            r + 1);
+                } else {
+                    aotGo(f, owner, r, ea, "    ");
+                }
+                continue;
+            case OP_MICRO:
+                if (!(inst & 00400)) {
+                    aotGroup1(f, inst);
+                    break;
+                }
+                if (endsBlock(inst)) aotGroup2(f, inst);
+                if (inst & 00200) fprintf(f, "    ac = 0;\n");
+                if (!endsBlock(inst)) break;
+                fprintf(f, "    if (t) {\n");
+                aotGo(f, owner, r, skip, "        ");
+                fprintf(f, "    }\n");
+                aotGo(f, owner, r, next, "    ");
+                continue;
+        }
+
+        // falls through to the next word, which is in the same block if
+        // this routine has it
+        if (owner[next] == r + 1 && next == a + 1) continue;
+        aotGo(f, owner, r, next, "    ");
+    }
+
+    fprintf(f,
+            "\nleave:\n"
+            "    c->reason = AOT_EXIT_LEAVE;\n"
+            "    goto out;\n"
+            "interpret:\n"
+            "    c->reason = AOT_EXIT_INTERPRET;\n"
+            "out:\n"
+            "    c->ac = ac;\n"
+            "    c->lk = lk;\n"
+            "    c->pc = pc;\n"
+            "    c->budget = budget;\n"
+            "    c->cycles = cycles;\n"
+            "}\n\n");
+}
+
+// Translate field 0 of m to C in path. With train, m first runs to the
+// end of its input, and every word it executed that still holds what the
+// image had is an entry too, after those found statically.
+static int aotGenerate(Machine *m, const char *path, int train) {
+    static uint16 memory[4096], owner[4096], entries[4096];
+    static uint16 stack[3 * 4096 + 1];
+    static unsigned char seen[4096], queued[4096];
+    static int count[4096], cycles[4096];
+    int routines = 0, entryCount = 0, trained = !train;
+
+    memcpy(memory, m->memory, sizeof(memory));
+    memset(owner, 0, sizeof(owner));
+    memset(seen, 0, sizeof(seen));
+    memset(queued, 0, sizeof(queued));
+    entries[entryCount++] = 00200;
+    queued[00200] = 1;
+    if (!queued[m->PC & 07777]) {
+        entries[entryCount++] = m->PC & 07777;
+        queued[m->PC & 07777] = 1;
+    }
+
+    // routines in the order they are found; a word belongs to the first,
+    // and the walk goes on past the words it leaves to stepSwitch()
+    for (int e = 0; e < entryCount || !trained; e++) {
+        if (e == entryCount) {
+            trained = 1;
+            if ((m->profile = calloc(1, sizeof(Profile))) == NULL) {
+                fprintf(stderr, "out of memory\n");
+                return 0;
+            }
+            m->engine = ENGINE_SWITCH;
+            run(m);
+            for (int a = 0; a < 4096; a++)
+                if (m->profile->count[a] && m->memory[a] == memory[a] &&
+                    !queued[a]) {
+                    entries[entryCount++] = a;
+                    queued[a] = 1;
+                }
+            e--;
+            continue;
+        }
+        if (seen[entries[e]]) continue;
+        int r = ++routines, depth = 0, words = 0;
+        stack[depth++] = entries[e];
+        while (depth) {
+            uint16 a = stack[--depth], next[3], entry;
+            if (seen[a]) continue;
+            seen[a] = 1;
+            if (translatable(memory[a])) {
+                owner[a] = r;
+                words++;
+            }
+            int n = aotSuccessors(memory, a, next);
+            for (int i = 0; i < n; i++)
+                if (!seen[next[i]]) stack[depth++] = next[i];
+            if (aotEntry(memory, a, &entry) && !queued[entry]) {
+                entries[entryCount++] = entry;
+                queued[entry] = 1;
+            }
+        }
+        if (words == 0) routines--;
+    }
+
+    // what entering each word charges: it and the words after it in the
+    // routine up to the next control transfer
+    for (int k = 0; k < 4096; k++) {
+        int a = 07777 - k;
+        count[a] = cycles[a] = 0;
+        if (!owner[a]) continue;
+        count[a] = 1;
+        cycles[a] = instCycles(memory[a], a);
+        uint16 next = (a + 1) & 07777;
+        if (!endsBlock(memory[a]) && owner[next] == owner[a] && next != 0) {
+            count[a] += count[next];
+            cycles[a] += cycles[next];
+        }
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    fprintf(f,
+            "// Field 0 of a PDP-8 image translated to C by pdp8 -G; link it "
+            "with pdp8.c\n// and run with -e aot.\n\n"
+            "#pragma GCC diagnostic ignored \"-Wunused-label\"\n"
+            "#pragma GCC diagnostic ignored \"-Wunused-variable\"\n\n"
+            "typedef unsigned short uint16;\n\n%s\n\n"
+            "#define AOT_VERSION %d\n"
+            "#define AOT_EXIT_LEAVE %d\n"
+            "#define AOT_EXIT_INTERPRET %d\n",
+            AOT_STRING(AOT_DEFINITIONS), AOT_VERSION, AOT_EXIT_LEAVE,
+            AOT_EXIT_INTERPRET);
+    const char *names[2] = {"image", "owner"};
+    const uint16 *tables[2] = {memory, owner};
+    for (int t = 0; t < 2; t++) {
+        fprintf(f, "\nstatic const uint16 %s[4096] = {", names[t]);
+        for (int a = 0; a < 4096; a++)
+            fprintf(f, "%s0%o,", a % 8 ? " " : "\n    ", tables[t][a]);
+        fprintf(f, "\n};\n");
+    }
+    fprintf(f, "\n");
+    for (int r = 0; r < routines; r++)
+        aotRoutine(f, memory, owner, r, count, cycles);
+    fprintf(f, "static void (*const routine[%d])(AotContext *) = {",
+            routines);
+    for (int r = 0, a = 0; r < routines; r++) {
+        while (owner[a] != r + 1) a++;
+        fprintf(f, "%sr%04o,", r % 6 ? " " : "\n    ", a);
+        a = 0;
+    }
+    fprintf(f,
+            "\n};\n\nconst AotUnit aotUnit = {AOT_VERSION, %d, image, owner, "
+            "routine};\n",
+            routines);
+    if (fclose(f) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    int words = 0;
+    for (int a = 0; a < 4096; a++) words += owner[a] != 0;
+    fprintf(stderr, "%d routines, %d words translated\n", routines, words);
+    return 1;
+}
+
+#ifdef AOT_SUPPORTED
+// Turn off translated routines whose code is not what was translated, or
+// that have a word the engines stop at. Every run() starts with this, since
+// memory may have been loaded or restored in between.
+static int aotAttach(Machine *m) {
+    if (&aotUnit == NULL || aotUnit.version != AOT_VERSION) return 0;
+    if (m->aot.off == NULL &&
+        (m->aot.off = malloc(aotUnit.routines)) == NULL)
+        return 0;
+    memset(m->aot.off, 0, aotUnit.routines);
+    for (int a = 0; a < 4096; a++)
+        if (aotUnit.owner[a] &&
+            (m->memory[a] != aotUnit.image[a] || stopsAt(m, a)))
+            m->aot.off[aotUnit.owner[a] - 1] = 1;
+    m->aot.context.memory = m->memory;
+    return 1;
+}
+
+// The word at address was stored into from outside translated code.
+static inline void aotWrote(Machine *m, unsigned address) {
+    unsigned r;
+    if (m->aot.off && address < 010000 && (r = aotUnit.owner[address]) &&
+        m->memory[address] != aotUnit.image[address])
+        m->aot.off[r - 1] = 1;
+}
+
+// Run translated routines, interpreting what they leave to stepSwitch().
+static void runAot(Machine *m) {
+    AotContext *c = &m->aot.context;
+
+    while (!m->attention && m->instructions < m->sliceEnd) {
+        long long budget = m->sliceEnd - m->instructions;
+        unsigned r;
+        c->budget = budget;
+        c->ac = m->AC;
+        c->lk = m->LK;
+        c->pc = m->PC;
+        while (!(m->IF | m->DF | m->fieldPending) &&
+               (r = aotUnit.owner[c->pc]) && !m->aot.off[r - 1]) {
+            aotUnit.routine[r - 1](c);
+            if (c->reason != AOT_EXIT_LEAVE || c->budget == 0) break;
+        }
+        m->AC = c->ac;
+        m->LK = c->lk;
+        m->PC = c->pc;
+        m->instructions += budget - c->budget;
+        m->cycles += c->cycles;
+        c->cycles = 0;
+        if (c->budget == 0) break;  // slice used up
+        stepNoting(m);
+    }
+}
+#endif
+
+// The word at address was stored into: drop any translated copy of it.
+// Only field 0 is translated.
+static inline void noteStore(Machine *m, unsigned address) {
+    if (address >= 010000) return;
+#ifdef JIT_SUPPORTED
+    if (m->jit.buffer && m->jit.context.code[address])
+        jitInvalidatePage(&m->jit, address);
+#endif
+#ifdef AOT_SUPPORTED
+    aotWrote(m, address);
+#endif
+}
+
+// Interpret one instruction for runJit() and runAot(), noting what it
+// stored. Direct operands are in the instruction field the instruction
+// ran in, indirect ones in the data field, and JMS stores into the field
+// it takes.
+static void stepNoting(Machine *m) {
+    uint16 pc = m->PC;
+    unsigned field = m->IF;
+    unsigned data = m->DF;
+    uint16 inst = m->ifMemory[pc];
+    int op = inst >> 9;
+
+    stepSwitch(m);
+    if (op >= OP_IO) return;
+    uint16 ea = (inst & 0177) | ((inst & 00200) ? pc & 07600 : 0);
+    int indirect = inst & 00400;
+    if (indirect && (ea & 07770) == 00010) noteStore(m, field | ea);
+    if (op == OP_JMS)
+        noteStore(m, m->IF | (m->address & 07777));
+    else if (op == OP_ISZ || op == OP_DCA)
+        noteStore(m, (indirect ? data : field) | m->address);
+}
+
+// Store into memory from outside the engines, dropping any predecoded or
+// translated copy of the word.
+static void writeMemory(Machine *m, uint16 address, uint16 value) {
+    m->memory[address] = value;
+    dropDecoded(m, address);
+    noteStore(m, address);
+}
+
+// Schedule device's next event delay instructions from now, replacing the
+// one it has pending.
+static void scheduleEvent(Machine *m, int device, long long delay) {
+    long long time = m->instructions + delay;
+
+    cancelEvent(m, device);
+    int i = m->eventCount++;
+    while (i > 0 && m->events[i - 1].time > time) {
+        m->events[i] = m->events[i - 1];
+        i--;
+    }
+    m->events[i].time = time;
+    m->events[i].device = device;
+}
+
+static void cancelEvent(Machine *m, int device) {
+    int i = 0;
+    while (i < m->eventCount && m->events[i].device != device) i++;
+    if (i == m->eventCount) return;
+    m->eventCount--;
+    memmove(&m->events[i], &m->events[i + 1],
+            (m->eventCount - i) * sizeof(Event));
+}
+
+static int interruptRequest(Machine *m) {
+    return (m->ttyInterrupts && (m->keyboardFlag || m->printerFlag)) ||
+           (m->tapeInterrupts && (m->readerFlag || m->punchFlag)) ||
+           ((m->rkCommand & RKC_IE) && (m->rkStatus & RKS_DONE)) ||
+           ((m->rfStatus & RFS_CIE) && m->rfDone) ||
+           ((m->rfStatus & RFS_EIE) && (m->rfStatus & RFS_ERRORS));
+}
+
+// Fire the device events that are due, then take an interrupt if a device
+// requests one, ION has taken effect and no CIF waits for its JMP: the PC
+// goes to location 0 of field 0 and execution continues at 1 with
+// interrupts off. An event can set the flag
+// an idle guest polls, so it is no longer known to be idle.
+static void serviceDevices(Machine *m) {
+    while (m->eventCount && m->events[0].time <= m->instructions) {
+        int device = m->events[0].device;
+        cancelEvent(m, device);
+        switch (device) {
+            case EVENT_KEYBOARD:
+                keyboardEvent(m);
+                break;
+            case EVENT_PRINTER:
+                m->printerFlag = 1;
+                break;
+            case EVENT_FLUSH:
+                flushPrinter(m);
+                break;
+            case EVENT_READER:
+                if (m->tapePosition >= m->tapeSize) break;  // another tape
+                m->readerBuffer = m->tape[m->tapePosition++];
+                m->readerFlag = 1;
+                break;
+            case EVENT_PUNCH:
+                m->punchFlag = 1;
+                break;
+            case EVENT_DISK:
+                rkFinish(m);
+                break;
+            case EVENT_DRUM:
+                rfFinish(m);
+                break;
+        }
+        m->idle = 0;
+    }
+
+    if (m->interruptEnable && m->instructions >= m->enableAt &&
+        !m->fieldPending && interruptRequest(m)) {
+        if (m->profile) profileCall(m->profile, 0, m->PC, m->instructions);
+        // the handler runs in field 0, and RMF gets the fields back
+        m->SF = m->IF >> 9 | m->DF >> 12;
+        m->IF = m->IB = m->DF = 0;
+        mapFields(m);
+        writeMemory(m, 0, m->PC);
+        m->PC = 1;
+        m->interruptEnable = 0;
+        m->idle = 0;
+        m->cycles++;  // the store, in place of the fetch it interrupted
+    }
+}
+
+// Connect the keyboard to a host file. Anything but a regular file is read
+// unbuffered, one character at a time, once poll() says it has one, so a
+// guest never stalls the emulator on a blocking read. Nothing is read until
+// the guest's first keyboard IOT, so start-up code that clears the flags
+// does not lose typed-ahead input.
+static void attachKeyboard(Machine *m, FILE *keyboard) {
+    struct stat st;
+
+    m->keyboard = keyboard;
+    m->keyboardPoll =
+        fstat(fileno(keyboard), &st) != 0 || !S_ISREG(st.st_mode);
+    if (m->keyboardPoll) setvbuf(keyboard, NULL, _IONBF, 0);
+    m->keyboardEOF = 0;
+
+    // a restored or forked machine whose reader had stopped reads on
+    if (m->keyboardReady && !m->keyboardFlag &&
+        eventDelay(m, EVENT_KEYBOARD) == NO_EVENT)
+        scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+}
+
+// Clear the keyboard flag and start reading the next character.
+static void keyboardClear(Machine *m) {
+    m->keyboardFlag = 0;
+    if (m->keyboardReady && !m->keyboardEOF)
+        scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+}
+
+// A skip IOT did not skip; the guest waits for the flag if the next
+// instruction jumps back to the IOT.
+static int flagLoop(Machine *m) {
+    return jumpsTo(m->ifMemory[m->PC], m->PC, (m->PC - 1) & 07777);
+}
+
+// Input/output transfer. PC already points past the IOT.
+static void executeIOT(Machine *m, uint16 inst) {
+    m->attention = 1;
+    switch ((inst >> 3) & 077) {
+        case 000:  // Interrupt system
+            switch (inst & 07) {
+                case 00:  // SKON
+                    if (m->interruptEnable) m->PC = (m->PC + 1) & 07777;
+                    m->interruptEnable = 0;
+                    break;
+                case 01:  // ION, after the next instruction
+                    m->interruptEnable = 1;
+                    m->enableAt = m->instructions + 1;
+                    break;
+                case 02:  // IOF
+                    m->interruptEnable = 0;
+                    break;
+                case 03:  // SRQ
+                    if (interruptRequest(m))
+                        m->PC = (m->PC + 1) & 07777;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 04:  // GTF
+                    m->AC = (m->LK ? 04000 : 0) |
+                            (m->greaterThan ? 02000 : 0) |
+                            (interruptRequest(m) ? 01000 : 0) |
+                            (m->fieldPending ? 00400 : 0) |
+                            (m->interruptEnable ? 00200 : 0) | m->SF;
+                    break;
+                case 05:  // RTF, and the fields from the low six bits
+                    m->LK = (m->AC & 04000) ? 010000 : 0;
+                    m->greaterThan = (m->AC & 02000) != 0;
+                    m->interruptEnable = 1;
+                    m->enableAt = m->instructions + 1;
+                    m->IB = (m->AC & 070) << 9;
+                    m->DF = (m->AC & 07) << 12;
+                    m->fieldPending = 1;
+                    mapFields(m);
+                    break;
+                case 07:  // CAF
+                    m->AC = 0;
+                    m->LK = 0;
+                    m->interruptEnable = 0;
+                    m->ttyInterrupts = 1;
+                    m->eaeModeB = 0;
+                    m->greaterThan = 0;
+                    m->printerFlag = 0;
+                    cancelEvent(m, EVENT_PRINTER);
+                    keyboardClear(m);
+                    m->tapeInterrupts = 1;
+                    m->readerFlag = 0;
+                    m->punchFlag = 0;
+                    cancelEvent(m, EVENT_READER);
+                    cancelEvent(m, EVENT_PUNCH);
+                    rkClear(m);
+                    m->rfStatus = 0;
+                    m->rfDone = 0;
+                    cancelEvent(m, EVENT_DRUM);
+                    break;
+            }
+            break;
+        case 001:  // High-speed reader
+            switch (inst & 07) {
+                case 00:  // RPE
+                    m->tapeInterrupts = 1;
+                    break;
+                case 01:  // RSF
+                    if (m->readerFlag) {
+                        m->PC = (m->PC + 1) & 07777;
+                        break;
+                    }
+                    // nothing will set the flag once the tape has run out
+                    if (m->tapePosition >= m->tapeSize &&
+                        eventDelay(m, EVENT_READER) == NO_EVENT &&
+                        flagLoop(m))
+                        m->halted = 1;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 02:  // RRB
+                    m->AC |= m->readerBuffer;
+                    m->readerFlag = 0;
+                    break;
+                case 04:  // RFC
+                    readerFetch(m);
+                    break;
+                case 06:  // RRB RFC
+                    m->AC |= m->readerBuffer;
+                    readerFetch(m);
+                    break;
+            }
+            break;
+        case 002:  // High-speed punch
+            switch (inst & 07) {
+                case 00:  // PCE
+                    m->tapeInterrupts = 0;
+                    break;
+                case 01:  // PSF
+                    if (m->punchFlag)
+                        m->PC = (m->PC + 1) & 07777;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 02:  // PCF
+                    m->punchFlag = 0;
+                    break;
+                case 04:  // PPC
+                    punchCharacter(m);
+                    break;
+                case 06:  // PLS
+                    m->punchFlag = 0;
+                    punchCharacter(m);
+                    break;
+            }
+            break;
+        case 003:  // Console keyboard input
+            if (!m->keyboardReady &&
+                (m->keyboard || m->replay || m->keyboardInput)) {
+                m->keyboardReady = 1;
+                scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+            }
+            switch (inst & 07) {
+                case 00:  // KCF
+                    keyboardClear(m);
+                    break;
+                case 01:  // KSF
+                    if (m->keyboardFlag) {
+                        m->PC = (m->PC + 1) & 07777;
+                        break;
+                    }
+                    // the guest wants input, so show what it printed
+                    flushPrinter(m);
+                    if (m->keyboardEOF && flagLoop(m))
+                        m->halted = 1;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 02:  // KCC
+                    keyboardClear(m);
+                    m->AC = 0;
+                    break;
+                case 04:  // KRS
+                    m->AC = m->AC | m->keyboardBuffer;
+                    break;
+                case 05:  // KIE
+                    m->ttyInterrupts = m->AC & 00001;
+                    break;
+                case 06:  // KRB
+                    keyboardClear(m);
+                    m->AC = m->keyboardBuffer;
+                    break;
+            }
+            break;
+        case 004:  // Console keyboard output
+            switch (inst & 07) {
+                case 00:  // TFL
+                    if (m->printerFlag == 0) {
+                        m->printerFlag = 1;
+                    }
+                    break;
+                case 01:  // TSF
+                    if (m->printerFlag) {
+                        m->PC = (m->PC + 1) & 07777;
+                    } else {
+                        m->idle = flagLoop(m);
+                    }
+                    break;
+                case 02:  // TCF
+                    m->printerFlag = 0;
+                    break;
+                case 04:  // TPC
+                    m->printerBuffer = m->AC & 00377;
+                    printCharacter(m);
+                    break;
+                case 05:  // TSK
+                    if (m->printerFlag || m->keyboardFlag) {
+                        m->PC = (m->PC + 1) & 07777;
+                    } else {
+                        m->idle = flagLoop(m);
+                    }
+                    break;
+                case 06:  // TLS
+                    m->printerFlag = 0;
+                    m->printerBuffer = m->AC & 00377;
+                    printCharacter(m);
+                    break;
+            }
+            break;
+        // KM8-E memory extension: CDF, CIF or both to field (inst >> 3) & 7,
+        // or with 04 set, RDF, RIF, RIB or RMF by that field number
+        case 020:
+        case 021:
+        case 022:
+        case 023:
+        case 024:
+        case 025:
+        case 026:
+        case 027:
+            if (inst & 04) {
+                switch ((inst >> 3) & 07) {
+                    case 01:  // RDF
+                        m->AC |= m->DF >> 9;
+                        break;
+                    case 02:  // RIF
+                        m->AC |= m->IF >> 9;
+                        break;
+                    case 03:  // RIB
+                        m->AC |= m->SF;
+                        break;
+                    case 04:  // RMF
+                        m->IB = (m->SF & 070) << 9;
+                        m->DF = (m->SF & 07) << 12;
+                        m->fieldPending = 1;
+                        mapFields(m);
+                        break;
+                }
+                break;
+            }
+            if (inst & 01) {  // CDF
+                m->DF = (inst & 070) << 9;
+                mapFields(m);
+            }
+            if (inst & 02) {  // CIF, from the next JMP or JMS
+                m->IB = (inst & 070) << 9;
+                m->fieldPending = 1;
+            }
+            break;
+        case 060:  // RF08 disk address and transfers
+            switch (inst & 07) {
+                case 01:  // DCMA
+                    m->rfAddress &= ~07777u;
+                    m->rfStatus &= ~RFS_ERRORS;
+                    m->rfDone = 0;
+                    break;
+                case 03:  // DMAR
+                case 05:  // DMAW
+                    m->rfAddress = (m->rfAddress & ~07777u) | m->AC;
+                    m->AC = 0;
+                    m->rfWrite = (inst & 07) == 05;
+                    m->rfDone = 0;
+                    scheduleEvent(m, EVENT_DRUM, RF_DELAY);
+                    break;
+            }
+            break;
+        case 061:  // RF08 interrupts and memory field
+            switch (inst & 07) {
+                case 01:  // DCIM
+                    m->rfStatus &= ~RFS_LOAD;
+                    break;
+                case 02:  // DSAC: no track timing, so never confirmed
+                    break;
+                case 05:  // DIML
+                    m->rfStatus = (m->rfStatus & ~RFS_LOAD) | (m->AC & RFS_LOAD);
+                    m->AC = 0;
+                    break;
+                case 06:  // DIMA
+                    m->AC = m->rfStatus;
+                    break;
+            }
+            break;
+        case 062:  // RF08 flags
+            switch (inst & 07) {
+                case 01:  // DFSE
+                    if (!(m->rfStatus & RFS_ERRORS))
+                        m->PC = (m->PC + 1) & 07777;
+                    break;
+                case 02:  // DFSC
+                case 03:  // DISK
+                    if (m->rfDone ||
+                        ((inst & 01) && (m->rfStatus & RFS_ERRORS)))
+                        m->PC = (m->PC + 1) & 07777;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 06:  // DMAC
+                    m->AC = m->rfAddress & 07777;
+                    break;
+            }
+            break;
+        case 064:  // RF08 extended disk address
+            switch (inst & 07) {
+                case 01:  // DCXA
+                    m->rfAddress &= 07777;
+                    break;
+                case 03:  // DXAL
+                    m->rfAddress = (m->rfAddress & 07777) | (m->AC & 0377) << 12;
+                    m->AC = 0;
+                    break;
+                case 05:  // DXAC
+                    m->AC = (m->rfAddress >> 12) & 0377;
+                    break;
+            }
+            break;
+        case 074:  // RK8-E
+            switch (inst & 07) {
+                case 01:  // DSKP
+                    if (m->rkStatus & RKS_DONE)
+                        m->PC = (m->PC + 1) & 07777;
+                    else
+                        m->idle = flagLoop(m);
+                    break;
+                case 02:  // DCLR
+                    switch (m->AC & 03) {
+                        case 01:  // the controller
+                            cancelEvent(m, EVENT_DISK);
+                            rkClear(m);
+                            break;
+                        case 02:  // recalibrate: a seek, over at once
+                            m->rkStatus =
+                                m->rkCommand & RKC_SEEK_DONE ? RKS_DONE : 0;
+                            break;
+                        default:  // the status
+                            m->rkStatus &= RKS_BUSY;
+                            break;
+                    }
+                    m->AC = 0;
+                    break;
+                case 03:  // DLAG
+                    m->rkBlock = m->AC;
+                    m->AC = 0;
+                    rkStart(m);
+                    break;
+                case 04:  // DLCA
+                    m->rkAddress = m->AC;
+                    m->AC = 0;
+                    break;
+                case 05:  // DRST
+                    m->AC = m->rkStatus;
+                    break;
+                case 06:  // DLDC
+                    m->rkCommand = m->AC;
+                    m->rkStatus &= RKS_BUSY;
+                    m->AC = 0;
+                    break;
+            }
+            break;
+    }
+}
+
+static uint16 getAddrPageZero(uint16 inst) { return ((inst & 0177)); }
+
+static uint16 getAddrPageCurrent(Machine *m, uint16 inst) {
+    return ((inst & 0177) | (m->PC & 07600));
+}
+
+// Follow the indirect word at address in the instruction field,
+// autoindexing 010 to 017. A trace record gets the word as it was.
+static inline uint16 getIndirectAddress(Machine *m, uint16 address,
+                                        TraceRecord *r) {
+    if (r) r->pointer = m->ifMemory[address];
+    if ((address & 07770) == 00010) {  // address 010 to 017
+        // autoindexed addressing
+        m->ifMemory[address] = (m->ifMemory[address] + 1) & 07777;
+        address = m->ifMemory[address];
+    } else {
+        // immediate addressing
+        address = (m->ifMemory[address]) & 07777;
+    }
+    return address;
+}
+
+static uint16 asciiToOctal(char c) {
+    uint16 ascii = (int)c;
+    return ascii - 48;
+}
+
+
+// Start logging keyboard input to a new file at path.
+static int recordKeyboard(Machine *m, const char *path) {
+    unsigned char header[KEYLOG_HEADER] = KEYLOG_MAGIC;
+    uint64_t hash = hashMemory(m->memory);
+
+    put16(header + 4, KEYLOG_VERSION);
+    put32(header + 8, hash & 0xffffffffu);
+    put32(header + 12, hash >> 32);
+    m->keylog = fopen(path, "wb");
+    if (m->keylog == NULL ||
+        fwrite(header, 1, KEYLOG_HEADER, m->keylog) != KEYLOG_HEADER ||
+        fflush(m->keylog) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    m->keylogTime = m->instructions;
+    return 1;
+}
+
+// Append a record for a character, or EOF, delivered now. Each record is
+// flushed, so the log is complete up to a crash; it costs a few bytes and
+// a write per character typed, and nothing between them.
+static void logKey(Machine *m, int input) {
+    unsigned char record[12];
+    int n = 0;
+    uint64_t v = (uint64_t)(m->instructions - m->keylogTime) << 1 |
+                 (input == EOF);
+
+    while (v >= 0200) {
+        record[n++] = (v & 0177) | 0200;
+        v >>= 7;
+    }
+    record[n++] = v;
+    if (input != EOF) record[n++] = input;
+    fwrite(record, 1, n, m->keylog);
+    fflush(m->keylog);
+    m->keylogTime = m->instructions;
+}
+
+// Take the keyboard's input from the log at path instead of the host. The
+// log must have been recorded from the memory m has now.
+static int replayKeyboard(Machine *m, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *map = MAP_FAILED;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= KEYLOG_HEADER)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot map keyboard log %s\n", path);
+        return 0;
+    }
+    const unsigned char *header = map;
+    uint64_t hash = get32(header + 8) | (uint64_t)get32(header + 12) << 32;
+    const char *error = NULL;
+    if (memcmp(header, KEYLOG_MAGIC, 4) != 0 ||
+        get16(header + 4) != KEYLOG_VERSION)
+        error = "not a keyboard log";
+    else if (hash != hashMemory(m->memory))
+        error = "recorded from another image";
+    if (error) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        munmap(map, st.st_size);
+        return 0;
+    }
+    m->replay = map;
+    m->replaySize = st.st_size;
+    m->replayPosition = KEYLOG_HEADER;
+    m->keylogTime = m->instructions;
+    m->keyboard = NULL;
+    m->keyboardEOF = 0;
+    if (m->keyboardReady && !m->keyboardFlag &&
+        eventDelay(m, EVENT_KEYBOARD) == NO_EVENT)
+        scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+    return 1;
+}
+
+// The keyboard reader is ready during a replay: deliver the next logged
+// character if this is when it came, or look again when it does. The log
+// running out is the end of the input.
+static void replayEvent(Machine *m) {
+    size_t p = m->replayPosition;
+    uint64_t v = 0;
+    int shift = 0, complete = 0;
+
+    while (p < m->replaySize && shift < 64) {
+        unsigned char b = m->replay[p++];
+        v |= (uint64_t)(b & 0177) << shift;
+        shift += 7;
+        if (!(b & 0200)) {
+            complete = 1;
+            break;
+        }
+    }
+    long long time =
+        complete ? m->keylogTime + (long long)(v >> 1) : m->instructions;
+    if (time > m->instructions) {
+        scheduleEvent(m, EVENT_KEYBOARD, time - m->instructions);
+        return;
+    }
+    m->keylogTime = time;
+    if (!complete || (v & 1) || p >= m->replaySize) {
+        m->replayPosition = m->replaySize;
+        m->keyboardEOF = 1;
+        return;
+    }
+    m->replayPosition = p + 1;
+    m->keyboardBuffer = m->replay[p];
+    m->keyboardFlag = 1;
+}
+
+// The keyboard reader is ready for its next character: take it if the host
+// has one, otherwise look again later. A guest that is idle with nothing
+// else pending can only be woken by the keyboard, so wait for the host, or
+// park if the machine must not block. A keyboard callback is never waited
+// on.
+static void keyboardEvent(Machine *m) {
+    if (m->replay) {
+        replayEvent(m);
+        return;
+    }
+    int wait = m->idle && m->eventCount == 0 &&
+               !(m->interruptEnable && m->enableAt > m->instructions);
+    int input;
+    if (m->keyboardInput) {
+        input = m->keyboardInput(m->keyboardContext);
+        if (input == PDP8_NO_INPUT) {
+            if (wait) m->parked = PARK_INPUT;
+            scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_POLL);
+            return;
+        }
+        if (input < 0) input = EOF;
+    } else {
+        if (m->keyboardPoll) {
+            struct pollfd p = {fileno(m->keyboard), POLLIN, 0};
+            if (poll(&p, 1, wait && !m->park ? -1 : 0) <= 0) {
+                if (wait && m->park) m->parked = PARK_INPUT;
+                scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_POLL);
+                return;
+            }
+        }
+        input = getc(m->keyboard);
+        if (input == EOF && errno == EAGAIN && ferror(m->keyboard)) {
+            clearerr(m->keyboard);  // a non-blocking descriptor raced poll()
+            scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_POLL);
+            return;
+        }
+        if (input == MONITOR_KEY && m->monitor &&
+            isatty(fileno(m->keyboard))) {
+            monitorSignal = 1;  // the guest never sees it
+            scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+            return;
+        }
+    }
+    if (input == EOF) {
+        m->keyboardEOF = 1;
+        if (m->keylog) logKey(m, EOF);
+        return;
+    }
+    if (m->lineFeeds && input == '\n') {
+        int afterReturn = m->lastInput == '\r';
+        m->lastInput = input;
+        if (afterReturn) {
+            scheduleEvent(m, EVENT_KEYBOARD, KEYBOARD_DELAY);
+            return;
+        }
+        input = '\r';
+    }
+    m->lastInput = input;
+    m->keyboardBuffer = input;
+    m->keyboardFlag = 1;
+    if (m->keylog) logKey(m, input);
+}
+
+// Clear the reader flag and start reading the next character, if the tape
+// has one.
+static void readerFetch(Machine *m) {
+    m->readerFlag = 0;
+    if (m->tapePosition < m->tapeSize)
+        scheduleEvent(m, EVENT_READER, READER_DELAY);
+}
+
+// Punch the low eight bits of AC.
+static void punchCharacter(Machine *m) {
+    m->punchBuffer = m->AC & 00377;
+    if (m->punch) putc(m->punchBuffer, m->punch);
+    scheduleEvent(m, EVENT_PUNCH, PUNCH_DELAY);
+}
+
+// Put the host file at path in the reader. It is mapped rather than read,
+// so a long tape costs nothing until the guest reads it.
+static int attachReader(Machine *m, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *map = MAP_FAILED;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size == 0) {
+        close(fd);
+        return 1;  // a blank tape
+    }
+    if (fd >= 0 && fstat(fd, &st) == 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot map tape %s\n", path);
+        return 0;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    m->tape = map;
+    m->tapeSize = st.st_size;
+    return 1;
+}
+
+// Punch into a new host file at path, written in large blocks.
+static int attachPunch(Machine *m, const char *path) {
+    m->punch = fopen(path, "w");
+    if (m->punch == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 0;
+    }
+    setvbuf(m->punch, NULL, _IOFBF, PUNCH_BUFFER);
+    return 1;
+}
+
+static inline uint16 imageWord(uint16 word) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap16(word);
+#else
+    return word;
+#endif
+}
+
+// Map the disk image at path, made size words of zeros if it is new or
+// empty. A private mapping keeps what the guest writes to this machine,
+// for lockstep; an image that cannot be written is write-locked.
+static int mapDisk(DiskImage *d, const char *path, size_t size, int private) {
+    struct stat st;
+    int locked = 0;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    void *map = MAP_FAILED;
+
+    if (fd < 0 && (fd = open(path, O_RDONLY)) >= 0) locked = 1;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        if (st.st_size == 0 && !locked && ftruncate(fd, size * 2) == 0)
+            st.st_size = size * 2;
+        if (st.st_size >= 2)
+            map = mmap(NULL, st.st_size,
+                       locked ? PROT_READ : PROT_READ | PROT_WRITE,
+                       private ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot map disk %s\n", path);
+        return 0;
+    }
+    d->words = map;
+    d->size = st.st_size / 2;
+    d->locked = locked;
+    return 1;
+}
+
+// Mount the -k and -x images on m's drives.
+static int attachDisks(Machine *m, int private) {
+    for (int i = 0; i < rkDrives; i++)
+        if (!mapDisk(&m->rk[i], rkPaths[i], RK_BLOCKS * RK_BLOCK, private))
+            return 0;
+    return rfPath == NULL || mapDisk(&m->rf, rfPath, RF_WORDS / 4, private);
+}
+
+// Toggle in the bootstrap of device, rk or rf, at its start address.
+static const char *bootDisk(Machine *m, const char *device) {
+    static const uint16 rk[] = {06007, 06744, 01032, 06746,
+                                06743, 01032, 05031, 00000};
+    static const uint16 rf[] = {06603, 06622, 05201, 05604, 07600};
+
+    if (strcmp(device, "rk") == 0) {
+        memcpy(&m->memory[00023], rk, sizeof(rk));
+        m->PC = 00023;
+    } else {
+        memcpy(&m->memory[00200], rf, sizeof(rf));
+        m->memory[RF_WC] = 07576;
+        m->memory[RF_CA] = 07576;
+        m->PC = 00200;
+    }
+    return NULL;
+}
+
+// Forget what was predecoded or translated from n words at address on.
+static void dropWords(Machine *m, unsigned address, unsigned n) {
+    for (unsigned i = 0; i < n; i++) dropDecoded(m, address + i);
+#ifdef JIT_SUPPORTED
+    if (m->jit.buffer && address < 010000)
+        for (unsigned page = address & 07600; page < address + n;
+             page += 0200)
+            jitInvalidatePage(&m->jit, page);
+#endif
+#ifdef AOT_SUPPORTED
+    for (unsigned i = 0; i < n; i++) aotWrote(m, address + i);
+#endif
+}
+
+// Data break: copy n words between a disk image and memory from address
+// on, wrapping within the field, in at most two runs. The loops are plain
+// copies that the compiler turns into vector moves.
+static void breakToMemory(Machine *m, unsigned address, const uint16 *from,
+                          unsigned n) {
+    unsigned field = address & 070000;
+    unsigned at = address & 07777;
+    while (n) {
+        unsigned run = 010000 - at < n ? 010000 - at : n;
+        uint16 *to = m->memory + field + at;
+        for (unsigned i = 0; i < run; i++) to[i] = imageWord(from[i]) & 07777;
+        dropWords(m, field + at, run);
+        from += run;
+        n -= run;
+        at = 0;
+    }
+}
+
+static void breakToDisk(Machine *m, unsigned address, uint16 *to,
+                        unsigned n) {
+    unsigned field = address & 070000;
+    unsigned at = address & 07777;
+    while (n) {
+        unsigned run = 010000 - at < n ? 010000 - at : n;
+        const uint16 *from = m->memory + field + at;
+        for (unsigned i = 0; i < run; i++) to[i] = imageWord(from[i]);
+        to += run;
+        n -= run;
+        at = 0;
+    }
+}
+
+// The controller after a CAF or DCLR: no command, status or addresses.
+static void rkClear(Machine *m) {
+    m->rkCommand = 0;
+    m->rkStatus = 0;
+    m->rkAddress = 0;
+    m->rkBlock = 0;
+    cancelEvent(m, EVENT_DISK);
+}
+
+static DiskImage *rkDrive(Machine *m) {
+    return &m->rk[(m->rkCommand & RKC_DRIVE) >> 1];
+}
+
+static unsigned rkBlockNumber(Machine *m) {
+    return (m->rkCommand & RKC_CYLINDER) << 12 | m->rkBlock;
+}
+
+// DLAG: start the command in the command register. What cannot be done
+// is done at once, with an error in the status.
+static void rkStart(Machine *m) {
+    DiskImage *d = rkDrive(m);
+    int function = (m->rkCommand >> 9) & 07;
+
+    if (m->rkStatus & RKS_BUSY) return;
+    if (d->words == NULL) {
+        m->rkStatus |= RKS_DONE | RKS_NOT_READY | RKS_DRIVE;
+    } else if ((size_t)(rkBlockNumber(m) + 1) * RK_BLOCK > d->size) {
+        m->rkStatus |= RKS_DONE | RKS_CYLINDER;
+    } else if (function == RK_WRITE_LOCK) {
+        d->locked = 1;
+        m->rkStatus |= RKS_DONE;
+    } else if ((function == RK_WRITE || function == RK_WRITE_ALL) &&
+               d->locked) {
+        m->rkStatus |= RKS_DONE | RKS_WRITE_LOCK;
+    } else if (function != RK_SEEK || (m->rkCommand & RKC_SEEK_DONE)) {
+        m->rkStatus |= RKS_BUSY;
+        scheduleEvent(m, EVENT_DISK, RK_DELAY);
+    }
+}
+
+// The RK8-E finishes its command: a transfer of a block or half a block,
+// or a seek.
+static void rkFinish(Machine *m) {
+    int function = (m->rkCommand >> 9) & 07;
+    unsigned words = m->rkCommand & RKC_HALF ? RK_BLOCK / 2 : RK_BLOCK;
+    uint16 *block = rkDrive(m)->words + (size_t)rkBlockNumber(m) * RK_BLOCK;
+    unsigned address = (m->rkCommand & RKC_FIELD) << 9 | m->rkAddress;
+
+    switch (function) {
+        case RK_READ:
+        case RK_READ_ALL:
+            breakToMemory(m, address, block, words);
+            break;
+        case RK_WRITE:
+        case RK_WRITE_ALL:
+            breakToDisk(m, address, block, words);
+            break;
+    }
+    if (function != RK_SEEK) m->rkAddress = (m->rkAddress + words) & 07777;
+    m->rkStatus = (m->rkStatus & ~RKS_BUSY) | RKS_DONE;
+}
+
+// The RF08 finishes its transfer. Each word takes a three-cycle data break
+// that counts up the word count and address in RF_WC and RF_CA; the
+// transfer runs until the count reaches zero or the disk ends. Unless it
+// overwrites the two words themselves, as the bootstrap does, it is done
+// as one bulk copy.
+static void rfFinish(Machine *m) {
+    unsigned count = (010000 - m->memory[RF_WC]) & 07777;
+    unsigned field = (m->rfStatus & RFS_FIELD) << 9;
+    unsigned address = (m->memory[RF_CA] + 1) & 07777;
+    size_t left = m->rfAddress < m->rf.size ? m->rf.size - m->rfAddress : 0;
+    uint16 *words = m->rf.words + m->rfAddress;
+    int error = 0;
+
+    if (count == 0) count = 010000;
+    if (m->rfWrite && m->rf.locked) {
+        error = RFS_WRITE_LOCK;
+        left = 0;
+    }
+    if (field == 0 && !m->rfWrite &&
+        (((RF_WC - address) & 07777) < count ||
+         ((RF_CA - address) & 07777) < count)) {
+        int last = 0;
+        for (count = 0; !last && count < left; count++) {
+            writeMemory(m, RF_WC, (m->memory[RF_WC] + 1) & 07777);
+            last = m->memory[RF_WC] == 0;
+            writeMemory(m, RF_CA, (m->memory[RF_CA] + 1) & 07777);
+            writeMemory(m, m->memory[RF_CA], imageWord(words[count]) & 07777);
+        }
+        if (!last && !error) error = RFS_NO_DISK;
+    } else {
+        if (count > left) {
+            if (!error) error = RFS_NO_DISK;
+            count = left;
+        }
+        if (m->rfWrite)
+            breakToDisk(m, field | address, words, count);
+        else
+            breakToMemory(m, field | address, words, count);
+        writeMemory(m, RF_WC, (m->memory[RF_WC] + count) & 07777);
+        writeMemory(m, RF_CA, (m->memory[RF_CA] + count) & 07777);
+    }
+    m->rfAddress = (m->rfAddress + count) & (RF_WORDS - 1);
+    m->rfStatus |= error;
+    m->rfDone = 1;
+}
+
+// Print the character in the printer buffer. It goes into the printer
+// ring, which is written out when the guest polls the keyboard, when the
+// ring is full, or flushInterval instructions after it stopped being empty.
+static void printCharacter(Machine *m) {
+    unsigned char ch = m->printerBuffer & 0177;
+
+    if (m->printerHead == m->printerTail)
+        scheduleEvent(m, EVENT_FLUSH, m->flushInterval);
+    m->printerRing[m->printerHead++ % PRINTER_RING] = ch;
+    if (m->printerHead - m->printerTail == PRINTER_RING) flushPrinter(m);
+    if (isDebug) flushPrinter(m);  // keep the trace in order
+    scheduleEvent(m, EVENT_PRINTER, PRINTER_DELAY);
+
+    if (m->sentinelLength) {
+        int n = m->sentinelLength;
+        m->recent[m->printed++ % n] = ch;
+        if (m->printed >= n) {
+            int i = 0;
+            while (i < n && m->recent[(m->printed + i) % n] == m->sentinel[i])
+                i++;
+            if (i == n) m->halted = 1;
+        }
+    }
+}
+
+// Write the printer ring out with as few writev() calls as it takes, or
+// hand it to the printer callback. Output that cannot be written (a closed
+// pipe, a full disk, no printer) is dropped. A machine that parks keeps
+// what a non-blocking printer would not take yet, and parks until it can; a
+// full ring is flushed as soon as it fills, so it never has to take another
+// character while it waits.
+static void flushPrinter(Machine *m) {
+    if (m->printerHead == m->printerTail) return;
+    cancelEvent(m, EVENT_FLUSH);
+    if (isDebug) fflush(stdout);
+    while (m->printerHead != m->printerTail) {
+        unsigned count = m->printerHead - m->printerTail;
+        unsigned start = m->printerTail % PRINTER_RING;
+        unsigned first = PRINTER_RING - start;
+        if (first > count) first = count;
+        if (m->printerOutput) {
+            m->printerOutput(m->printerContext,
+                             (const char *)m->printerRing + start, first);
+            m->printerTail += first;
+            continue;
+        }
+        if (m->printer == NULL) {  // nowhere to print
+            m->printerTail = m->printerHead;
+            break;
+        }
+        struct iovec iov[2] = {{m->printerRing + start, first},
+                               {m->printerRing, count - first}};
+        ssize_t n = writev(fileno(m->printer), iov, count > first ? 2 : 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && m->park && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            m->parked = PARK_OUTPUT;
+            break;
+        }
+        if (n <= 0) {
+            m->printerTail = m->printerHead;
+            break;
+        }
+        m->printerTail += n;
+    }
+}
+
+// Map a binary trace ring of the given number of records over path, empty.
+static int openTrace(Machine *m, const char *path, uint32_t records) {
+    size_t size = TRACE_HEADER + (size_t)records * sizeof(TraceRecord);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, size) == 0)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot map trace %s\n", path);
+        return 0;
+    }
+
+    unsigned char *header = map;
+    memcpy(header, TRACE_MAGIC, 4);
+    *(uint16 *)(header + 4) = TRACE_VERSION;
+    *(uint16 *)(header + 6) = sizeof(TraceRecord);
+    *(uint32_t *)(header + 8) = records;
+    m->traceCount = (uint64_t *)(header + 16);
+    m->trace = (TraceRecord *)(header + TRACE_HEADER);
+    m->traceCapacity = records;
+    return 1;
+}
+
+static void closeTrace(Machine *m) {
+    if (m->trace == NULL) return;
+    munmap((unsigned char *)m->trace - TRACE_HEADER,
+           TRACE_HEADER + (size_t)m->traceCapacity * sizeof(TraceRecord));
+    m->trace = NULL;
+}
+
+// Append r to the trace ring, and print it for -d.
+static void traceInst(Machine *m, const TraceRecord *r) {
+    if (m->trace) m->trace[(*m->traceCount)++ % m->traceCapacity] = *r;
+    if (isDebug) printTrace(r);
+}
+
+// Print the records in a binary trace ring, oldest first, as -d would have.
+static int decodeTrace(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= TRACE_HEADER)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot read trace %s\n", path);
+        return 0;
+    }
+
+    const unsigned char *header = map;
+    uint32_t capacity = *(const uint32_t *)(header + 8);
+    uint64_t count = *(const uint64_t *)(header + 16);
+    int ok = memcmp(header, TRACE_MAGIC, 4) == 0 &&
+             *(const uint16 *)(header + 4) == TRACE_VERSION &&
+             *(const uint16 *)(header + 6) == sizeof(TraceRecord) &&
+             capacity > 0 &&
+             (uint64_t)st.st_size >=
+                 TRACE_HEADER + (uint64_t)capacity * sizeof(TraceRecord);
+    if (ok) {
+        const TraceRecord *ring =
+            (const TraceRecord *)(header + TRACE_HEADER);
+        uint64_t n = count > capacity ? count - capacity : 0;
+        for (; n < count; n++) printTrace(&ring[n % capacity]);
+    } else {
+        fprintf(stderr, "%s: not a trace\n", path);
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+// Print one trace record in the -d format.
+static void printTrace(const TraceRecord *r) {
+    uint16 inst = r->inst;
+
+    printf("\n");
+    printDebug(r);
+    printDebugMicro(inst, r->flags & TRACE_MODE_B);
+
+    int op = (inst >> 9) & 07;
+    if (op >= OP_IO) return;
+    if (inst & 00400) {
+        uint16 at = (inst & 0177) | ((inst & 00200) ? (r->pc & 07600) : 0);
+        if ((at & 07770) == 00010)
+            printf("[autoindex: address = M[%o] + 1 = %o + 1] ", at,
+                   r->pointer);
+        else
+            printf("[immediate: address = M[%o] = %o] ", at, r->pointer);
+    }
+    switch (op) {
+        case OP_AND:
+            printf("[AC = AC & M[%o] = %o & %o = %o] ", r->address, r->ac,
+                   r->operand, (r->ac & r->operand));
+            break;
+        case OP_TAD:
+            printf("[L|AC = L|AC + M[%o] = %o + %o = %o] ", r->address,
+                   (r->lk | r->ac), r->operand,
+                   ((r->ac | r->lk) + r->operand));
+            break;
+        case OP_ISZ:
+            printf("[M[%o] = M[%o] + 1 = %o + 1 = %o] ", r->address,
+                   r->address, r->operand, ((r->operand + 1) & 07777));
+            break;
+        case OP_DCA:
+            printf("[M[%o] = AC = %o; AC = 0] ", r->address, r->ac);
+            break;
+        case OP_JMS:
+            printf("[M[%o] = returnPC = %o; new PC = %o] ", r->address,
+                   ((r->pc + 1) & 07777), ((r->address + 1) & 07777));
+            break;
+        case OP_JMP:
+            printf("[new PC = %o] ", (r->address & 07777));
+            break;
+    }
+}
+
+static void printDebug(const TraceRecord *r) {
+    char *op;
+    unsigned char I_str = (r->inst & 00400) ? 'I' : 'D';
+    unsigned char page_str = (r->inst & 00200) ? 'C' : 'Z';
+    switch (r->inst >> 9) {
+        case OP_AND:
+            op = "OP_AND";
+            break;
+        case OP_TAD:
+            op = "OP_TAD";
+            break;
+        case OP_ISZ:
+            op = "OP_ISZ";
+            break;
+        case OP_DCA:
+            op = "OP_DCA";
+            break;
+        case OP_JMS:
+            op = "OP_JMS";
+            break;
+        case OP_JMP:
+            op = "OP_JMP";
+            break;
+        case OP_IO:
+            op = "OP_IO";
+            break;
+        case OP_MICRO:
+            op = "OP_MICRO";
+            I_str = '-';
+            page_str = '-';
+            break;
+    }
+    printf("PC: %o, INST: %o, AC: %o, LK: %o; (%s %c %c) ", r->pc, r->inst,
+           r->ac, r->lk, op, I_str, page_str);
+}
+
+// Prints an operate instruction from the same table operateGroup1() and
+// operateGroup2() run it from.
+static void printDebugMicro(uint16 inst, int modeB) {
+    static const char *rotates[8] = {
+        "",     "BSW ",          "RAL ",     "RTL (RAL BSW) ",
+        "RAR ", "RTR (RAR BSW) ", "RAR RAL ", "RAR RAL BSW "};
+    const Operate *o = &operates[inst & 00777];
+
+    if (inst >> 9 != OP_MICRO) return;
+    if ((inst & 00401) == 00401) {
+        printDebugGroup3(inst, modeB);
+    } else if ((inst & 00400) == 0) {
+        printf("Grp 1, ");
+        if (!(o->keep & 07777)) printf("CLA ");
+        if (!(o->keep & 010000)) printf("CLL ");
+        if (o->flip & 07777) printf("CMA ");
+        if (o->flip & 010000) printf("CML ");
+        if (o->iac) printf("IAC ");
+        printf("%s", rotates[o->rotateBits]);
+    } else {
+        const char **names = group2Names[o->skipSense];
+        printf("Grp 2, %s: ", o->skipSense ? "and" : "or");
+        for (int bit = 0; bit < 3; bit++)
+            if (o->skipMask & 04 >> bit) printf("%s ", names[bit + 1]);
+        if (!o->skipMask) printf(o->skipSense ? "unconditional skp " : "NOP ");
+        if (!(o->keep & 07777)) printf("CLA ");
+    }
+}
+
+static void printDebugGroup3(uint16 inst, int modeB) {
+    static const char *modeA[8] = {"",    "SCL ", "MUY ", "DVI ",
+                                   "NMI ", "SHL ", "ASR ", "LSR "};
+    static const char *codeB[16] = {
+        "",     "ACS ",  "MUY ",  "DVI ", "NMI ",  "SHL ",  "ASR ", "LSR ",
+        "SCA ", "DAD ", "DST ", "SWBA ", "DPSZ ", "DPIC ", "DCM ", "SAM "};
+    int code = (inst >> 1) & 07;
+
+    printf("Grp 3, mode %c: ", modeB ? 'B' : 'A');
+    if (inst & 00200) printf("CLA ");
+    if (inst & 00100) printf("MQA ");
+    if ((inst & 00040) && !modeB) printf("SCA ");
+    if (inst & 00020) printf("MQL ");
+    if (inst == 07431)
+        printf("SWAB ");
+    else if (modeB)
+        printf("%s", codeB[code | ((inst & 00040) >> 2)]);
+    else
+        printf("%s", modeA[code]);
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+// Embedding interface to the emulator in pdp8.c. Built with
+//
+//   cc -c -DPDP8_LIBRARY pdp8.c
+//
+// the file has everything but main(), so a host program can run any number
+// of machines in one process, each in short slices from its own scheduler,
+// with the console keyboard and printer going through callbacks instead of
+// a terminal. A machine is used by one thread at a time; different machines
+// share nothing but the read-only defaults the pdp8 front end sets.
+#ifndef PDP8_H
+#define PDP8_H
+
+#include <stddef.h>
+
+typedef struct Pdp8 Pdp8;
+
+// Execution engines
+#define PDP8_SWITCH 0    // reference interpreter
+#define PDP8_THREADED 1  // predecoded, threaded dispatch
+#define PDP8_JIT 2       // x86-64 Linux; the threaded engine elsewhere
+#define PDP8_AOT 3       // a translation linked in (pdp8 -G), if there is one
+
+// Why pdp8Run() returned
+#define PDP8_LIMIT 0   // ran the instructions it was given
+#define PDP8_INPUT 1   // the guest waits for input the keyboard has not got
+#define PDP8_HALTED 2  // the guest waits for input after its end
+
+// Registers for pdp8Register() and pdp8SetRegister()
+#define PDP8_AC 0
+#define PDP8_LINK 1
+#define PDP8_PC 2
+#define PDP8_MQ 3
+#define PDP8_IF 4   // instruction field, 0 to 7
+#define PDP8_DF 5   // data field, 0 to 7
+#define PDP8_ION 6  // interrupts enabled
+
+// What a keyboard callback returns when it has no character yet
+#define PDP8_NO_INPUT (-2)
+
+// A machine with the engine, memory cleared, no image loaded and nothing
+// attached: keyboard input has ended and printer output is dropped. NULL if
+// the engine is not one of PDP8_* above or there is no memory for it.
+Pdp8 *pdp8New(int engine);
+void pdp8Free(Pdp8 *m);  // NULL is ignored
+
+// Load a core image, paper tape or octal dump, and set the PC to its start
+// address; a machine that already ran goes on with the new program. Returns
+// NULL, or why the image did not load.
+const char *pdp8Load(Pdp8 *m, const char *path);
+
+// Run up to instructions instructions, returning PDP8_*. Printer output is
+// handed to the printer callback before it returns.
+int pdp8Run(Pdp8 *m, long long instructions);
+
+// Run one instruction.
+int pdp8Step(Pdp8 *m);
+
+// Instructions run since the machine was made.
+long long pdp8Instructions(Pdp8 *m);
+
+unsigned pdp8Register(Pdp8 *m, int reg);
+void pdp8SetRegister(Pdp8 *m, int reg, unsigned value);
+
+// Memory, by 15-bit address (field << 12 | address)
+unsigned pdp8Read(Pdp8 *m, unsigned address);
+void pdp8Write(Pdp8 *m, unsigned address, unsigned value);
+
+// The keyboard asks input for each character as the guest is ready for it:
+// a character, PDP8_NO_INPUT for none yet, or -1 (EOF) for no more. A guest
+// left with nothing to do but wait makes pdp8Run() return PDP8_INPUT.
+void pdp8Keyboard(Pdp8 *m, int (*input)(void *context), void *context);
+
+// The printer hands output what the guest printed, in runs.
+void pdp8Printer(Pdp8 *m,
+                 void (*output)(void *context, const char *text,
+                                size_t length),
+                 void *context);
+
+#endif